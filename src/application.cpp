@@ -5,6 +5,7 @@
 #include <GLFW/glfw3.h>
 #include "shader_manager.h"
 #include "utility/utility.hpp"
+#include "constants.h"
 #include "asset_managment/asset_loader.h"
 #include "asset_managment/asset_manager.h"
 #include "scene/game_scene.h"
@@ -15,11 +16,13 @@ namespace fs = std::filesystem;
 
 void Application::initialize()
 {
-    if (!fs::is_directory("cache")) {
-        try {
-            fs::create_directory("cache");
-        } catch (std::exception& e) {
-            logger.LogError("Could not create cache directory: ", e.what());
+    for (auto& dir : { cDirCache, cDirExports }) {
+        if (!fs::is_directory(dir)) {
+            try {
+                fs::create_directory(dir);
+            } catch (std::exception& e) {
+                logger.LogError("Could not create ", dir.string(), " directory: ", e.what());
+            }
         }
     }
 
@@ -0,0 +1,264 @@
+// Headless benchmark of the fractal code on the CPU backend (target mandelbulb_bench).
+// Renders a fixed set of cameras at fixed sizes, reports the throughput and the work per pixel, writes the results as
+// JSON and compares them with the JSON of an earlier run:
+//
+//   mandelbulb_bench [--out results.json] [--baseline baseline.json] [--tolerance 0.25] [--repeat 15] [--isa scalar|avx2|avx512]
+//
+// The exit code is 1 if a camera got slower than the baseline by more than the tolerance or takes more distance
+// estimates per pixel. The estimate counts are exact and the same on every machine, a change in them is a change of
+// the algorithm; the throughput is only comparable on the machine and build the baseline was taken with. The medians of
+// 15 renders varied by 4-9% between runs for most cameras and by up to 19% (quaternion_julia) on a quiet machine, the
+// default tolerance is above that. The fastest render of each camera varied as much and is not compared
+#include <json/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "cpu/cpu_backend.h"
+#include "fractal/deep_zoom.h"
+#include "fractal/mandelbulb.h"
+#include "fractal/pixel_counters.h"
+#include "utility/thread_pool.h"
+
+struct BenchCamera {
+    const char* name;
+    uint32_t width, height;
+    double zoom, offsetX, offsetY;
+    bool normalSurface;
+    FormulaMode formula;
+    float power;
+    FractalType type = FractalType::Mandelbulb;
+};
+
+// The cameras of the suite. Renaming one or changing its parameters makes the baselines of it meaningless
+static const BenchCamera cBenchCameras[] = {
+    { "full_view", 640, 360, 1.0, 0.0, 0.0, false, FormulaMode::Triplex, 12.0f },
+    { "full_view_normals", 640, 360, 1.0, 0.0, 0.0, true, FormulaMode::Triplex, 12.0f },
+    { "close_up", 640, 360, 16.0, 0.02, 0.03, false, FormulaMode::Triplex, 12.0f },
+    { "close_up_normals", 640, 360, 16.0, 0.02, 0.03, true, FormulaMode::Triplex, 12.0f },
+    { "generic_full_view", 640, 360, 1.0, 0.0, 0.0, true, FormulaMode::Trigonometric, 8.0f },
+    { "deep_zoom", 320, 180, 1e5, 0.02, 0.03, true, FormulaMode::Triplex, 12.0f },
+    { "mandelbox", 640, 360, 1.0, 0.0, 0.0, true, FormulaMode::Triplex, 12.0f, FractalType::Mandelbox },
+    { "quaternion_julia", 640, 360, 1.0, 0.0, 0.0, true, FormulaMode::Triplex, 12.0f, FractalType::QuaternionJulia },
+    { "menger_sponge", 640, 360, 1.0, 0.0, 0.0, true, FormulaMode::Triplex, 12.0f, FractalType::MengerSponge },
+};
+
+// the frame the Renderer builds for the camera with the default settings (cone prepass, deep zoom, no brick map)
+static FrameConstants buildBenchFrame(const BenchCamera& camera)
+{
+    FrameConstants frame = {};
+    glm::dmat4 rayTransform = buildRayTransform(camera.zoom, camera.offsetX, camera.offsetY);
+    frame.rayTransform = glm::mat4(rayTransform);
+    frame.objectRotation = buildObjectRotation(glm::vec3(0.0f));
+    frame.fractal.type = camera.type;
+    frame.fractal.formula = camera.formula;
+    frame.fractal.power = camera.power;
+    frame.boundingRadius = fractalBoundingRadius(frame.fractal);
+    frame.width = camera.width;
+    frame.height = camera.height;
+    frame.normalSurface = camera.normalSurface;
+    frame.conePrepass = true;
+    adaptToPixelFootprint(frame);
+    adaptToDeepZoom(frame, rayTransform);
+    return frame;
+}
+
+// counts the estimates taken through it, the normals included
+template <typename DE>
+struct CountingEstimator {
+    DE de;
+    uint64_t* count;
+
+    float operator()(glm::vec3 pos, const glm::mat3& rotation) const {
+        ++*count;
+        return de(pos, rotation);
+    }
+    // an analytic gradient counts as one estimate, it runs the iteration once (with dual numbers). See cGradientTaps
+    glm::vec3 gradient(glm::vec3 pos, const glm::mat3& rotation) const {
+        *count += cGradientTaps<DE>;
+        return de.gradient(pos, rotation);
+    }
+};
+
+// Distance estimates per pixel of the frame on the scalar path: cone prepass, marches and normals.
+// The packet marchers take the same steps, apart from rays they stop early once they leave the escape radius
+static double estimatesPerPixel(const FrameConstants& frame)
+{
+    std::vector<uint64_t> rowCounts(frame.height, 0);
+    if (frame.deepZoom) {
+        ReferenceOrbit orbit;
+        computeReferenceOrbit(frame, orbit);
+        PerturbedMandelbulb de = { &orbit, frame.fractal, frame.fractal.minDistance };
+        theThreadPool.parallelFor(frame.height, [&](size_t y) {
+            for (uint32_t x = 0; x < frame.width; ++x) {
+                float hitDistance;
+                int evaluations;
+                shadeSample((float)x, (float)y, frame, de, 0.0f, nullptr, &hitDistance, &evaluations);
+                // the gradient of the deep path takes central differences
+                rowCounts[y] += (uint64_t)evaluations + (frame.normalSurface && hitDistance > 0.0f ? 6 : 0);
+            }
+        });
+    } else {
+        dispatchDistanceEstimator(frame.fractal, [&](auto de) {
+            uint32_t coneTilesX = (frame.width + cConeTileSize - 1) / cConeTileSize;
+            uint32_t coneTilesY = (frame.height + cConeTileSize - 1) / cConeTileSize;
+            std::vector<float> coneStart((size_t)coneTilesX * coneTilesY, 0.0f);
+            std::vector<uint64_t> coneCounts(coneTilesY, 0);
+            if (frame.conePrepass) {
+                theThreadPool.parallelFor(coneTilesY, [&](size_t tileY) {
+                    CountingEstimator<decltype(de)> counting = { de, &coneCounts[tileY] };
+                    for (uint32_t tileX = 0; tileX < coneTilesX; ++tileX)
+                        coneStart[tileY * coneTilesX + tileX] = coneMarch(tileX, (uint32_t)tileY, frame, counting);
+                });
+            }
+            theThreadPool.parallelFor(frame.height, [&](size_t y) {
+                CountingEstimator<decltype(de)> counting = { de, &rowCounts[y] };
+                for (uint32_t x = 0; x < frame.width; ++x)
+                    shadeSample((float)x, (float)y, frame, counting, coneStart[(y / cConeTileSize) * coneTilesX + x / cConeTileSize]);
+            });
+            for (uint64_t count : coneCounts) rowCounts[0] += count;
+        });
+    }
+    uint64_t total = 0;
+    for (uint64_t count : rowCounts) total += count;
+    return (double)total / ((double)frame.width * frame.height);
+}
+
+// FNV-1a of the image, changes with every changed pixel
+static std::string imageHash(const uint32_t* image, uint32_t width, uint32_t height, uint32_t stride)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t y = 0; y < height; ++y) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(image + (size_t)y * stride);
+        for (size_t i = 0; i < width * sizeof(uint32_t); ++i) hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+    return text;
+}
+
+// stride: width of the CPU image (allocateCpuImage), the rows of every camera start that far apart
+static nlohmann::json benchCamera(const BenchCamera& camera, uint32_t stride, int repeat)
+{
+    FrameConstants frame = buildBenchFrame(camera);
+    renderCpu(frame); // warm up, the first frame pays for the page faults
+    std::vector<double> milliseconds;
+    CpuRenderStats stats;
+    for (int i = 0; i < repeat; ++i) {
+        renderCpu(frame);
+        stats = getCpuRenderStats();
+        milliseconds.push_back(stats.milliseconds);
+    }
+    std::sort(milliseconds.begin(), milliseconds.end());
+    double median = milliseconds[milliseconds.size() / 2];
+
+    nlohmann::json result;
+    result["name"] = camera.name;
+    result["width"] = camera.width;
+    result["height"] = camera.height;
+    result["deep_zoom"] = frame.deepZoom;
+    result["milliseconds"] = median;
+    result["milliseconds_min"] = milliseconds.front();
+    result["megapixels_per_second"] = (double)camera.width * camera.height / (median * 1e3);
+    // march steps of the timed backend, estimates of every kind on the scalar path
+    result["march_steps_per_pixel"] = stats.stepsPerSample;
+    result["estimates_per_pixel"] = estimatesPerPixel(frame);
+    result["image_hash"] = imageHash(getCpuImage(), camera.width, camera.height, stride);
+    return result;
+}
+
+// prints the comparison with the baseline, returns the number of regressions
+static int compareWithBaseline(const nlohmann::json& results, const nlohmann::json& baseline, double tolerance)
+{
+    int regressions = 0;
+    printf("\n%-20s %14s %14s %9s %12s %12s\n", "camera", "Mpixel/s", "baseline", "change", "estimates", "baseline");
+    for (auto& result : results["cameras"]) {
+        auto it = std::find_if(baseline["cameras"].begin(), baseline["cameras"].end(), [&](const nlohmann::json& b) { return b["name"] == result["name"]; });
+        if (it == baseline["cameras"].end()) {
+            printf("%-20s not in the baseline\n", result["name"].get<std::string>().c_str());
+            continue;
+        }
+        double speed = result["megapixels_per_second"], baseSpeed = (*it)["megapixels_per_second"];
+        double estimates = result["estimates_per_pixel"], baseEstimates = (*it)["estimates_per_pixel"];
+        double change = baseSpeed > 0.0 ? speed / baseSpeed - 1.0 : 0.0;
+        bool slower = change < -tolerance;
+        bool moreWork = estimates > baseEstimates * (1.0 + 1e-6);
+        regressions += slower || moreWork;
+        printf("%-20s %14.3f %14.3f %+8.1f%% %12.3f %12.3f%s%s%s\n", result["name"].get<std::string>().c_str(), speed, baseSpeed, change * 100.0,
+            estimates, baseEstimates, slower ? "  SLOWER" : "", moreWork ? "  MORE ESTIMATES" : "",
+            result["image_hash"] != (*it)["image_hash"] ? "  (image changed)" : "");
+    }
+    if (baseline.value("isa", "") != results["isa"] || baseline.value("threads", 0) != results["threads"]) {
+        printf("note: the baseline was taken with %s on %d threads, the throughput is not comparable\n",
+            baseline.value("isa", "?").c_str(), baseline.value("threads", 0));
+    }
+    return regressions;
+}
+
+int main(int argc, char** argv)
+{
+    std::string outPath = "mandelbulb_bench.json", baselinePath;
+    double tolerance = 0.25;
+    int repeat = 15;
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--out") && hasValue) outPath = argv[++i];
+        else if (!strcmp(argv[i], "--baseline") && hasValue) baselinePath = argv[++i];
+        else if (!strcmp(argv[i], "--tolerance") && hasValue) tolerance = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--repeat") && hasValue) repeat = std::max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "--isa") && hasValue) {
+            const char* name = argv[++i];
+            SimdIsa isa = !strcmp(name, "avx512") ? SimdIsa::Avx512 : !strcmp(name, "avx2") ? SimdIsa::Avx2 : SimdIsa::Scalar;
+            if (!isSimdIsaSupported(isa)) {
+                fprintf(stderr, "%s is not supported by this processor\n", name);
+                return 2;
+            }
+            setCpuSimdIsa(isa);
+        } else {
+            fprintf(stderr, "usage: %s [--out file] [--baseline file] [--tolerance fraction] [--repeat n] [--isa scalar|avx2|avx512]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    uint32_t maxWidth = 0, maxHeight = 0;
+    for (auto& camera : cBenchCameras) {
+        maxWidth = std::max(maxWidth, camera.width);
+        maxHeight = std::max(maxHeight, camera.height);
+    }
+    allocateCpuImage(maxWidth, maxHeight);
+
+    nlohmann::json results;
+    results["isa"] = toString(getCpuSimdIsa());
+    results["threads"] = theThreadPool.threadCount();
+    results["repeat"] = repeat;
+    results["cameras"] = nlohmann::json::array();
+    printf("%-20s %10s %10s %12s %12s\n", "camera", "ms", "Mpixel/s", "steps/px", "estimates/px");
+    for (auto& camera : cBenchCameras) {
+        nlohmann::json result = benchCamera(camera, maxWidth, repeat);
+        printf("%-20s %10.2f %10.3f %12.3f %12.3f\n", camera.name, result["milliseconds"].get<double>(), result["megapixels_per_second"].get<double>(),
+            result["march_steps_per_pixel"].get<double>(), result["estimates_per_pixel"].get<double>());
+        results["cameras"].push_back(result);
+    }
+
+    std::ofstream out(outPath);
+    out << results.dump(2) << '\n';
+    if (!out.good()) {
+        fprintf(stderr, "could not write %s\n", outPath.c_str());
+        return 2;
+    }
+    printf("results written to %s\n", outPath.c_str());
+
+    if (baselinePath.empty()) return 0;
+    std::ifstream in(baselinePath);
+    nlohmann::json baseline = nlohmann::json::parse(in, nullptr, false);
+    if (baseline.is_discarded() || !baseline.contains("cameras")) {
+        fprintf(stderr, "could not read the baseline %s\n", baselinePath.c_str());
+        return 2;
+    }
+    int regressions = compareWithBaseline(results, baseline, tolerance);
+    printf("%d regression%s against %s\n", regressions, regressions == 1 ? "" : "s", baselinePath.c_str());
+    return regressions > 0 ? 1 : 0;
+}
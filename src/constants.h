@@ -8,6 +8,7 @@ inline std::filesystem::path cDirShader = "shaders";
 inline std::filesystem::path cDirShaderSources = "../src/shaders";
 inline std::filesystem::path cDirCache = "cache";
 inline std::filesystem::path cDirModels = "models";
+inline std::filesystem::path cDirExports = "exports";
 inline bool cLogAssetLoading = false;
 inline bool cDebugValidationLayers = true;
 inline bool cDebugObjectNames = true;
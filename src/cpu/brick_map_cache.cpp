@@ -0,0 +1,176 @@
+#include "cpu/brick_map_cache.h"
+#include "utility/thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+// file layout: header, then centreDistance, brickIndex and bricks as raw arrays
+struct BrickMapFileHeader {
+    char magic[4] = { 'F', 'B', 'R', 'K' };
+    uint32_t version = 1;
+    uint64_t key = 0;
+    int32_t resolution = 0;
+    int32_t brickCells = cBrickCells;
+    float extent = 0.0f;
+    uint32_t brickCount = 0;
+};
+
+// name of the file of the map with this key and resolution
+static std::string brickMapFileName(uint64_t key, int resolution)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "brickmap_%016llx_%d.bin", (unsigned long long)key, resolution);
+    return name;
+}
+
+uint64_t BrickMapCache::brickMapKey(const FrameConstants& frame)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const auto& value) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t i = 0; i < sizeof(value); ++i) hash = (hash ^ bytes[i]) * 1099511628211ull;
+    };
+    add(frame.objectRotation);
+    add(frame.fractal.type);
+    add(frame.fractal.formula);
+    add(frame.fractal.power);
+    add(frame.fractal.boxScale);
+    add(frame.fractal.juliaC);
+    add(frame.fractal.iterations);
+    return hash;
+}
+
+void BrickMapCache::build(const FrameConstants& frame)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    key = brickMapKey(frame);
+    // the cube around the bounding sphere, or around the escape radius for powers without one
+    float bound = fractalBoundingRadius(frame.fractal);
+    extent = bound > 0.0f ? bound : 2.0f;
+    float cellSize = 2.0f * extent / (float)resolution;
+    glm::vec3 origin = glm::vec3(-extent);
+    size_t cells = (size_t)resolution * resolution * resolution;
+    centreDistance.assign(cells, 0.0f);
+    brickIndex.assign(cells, -1);
+
+    dispatchDistanceEstimator(frame.fractal, [&](auto de) {
+        theThreadPool.parallelFor((size_t)resolution * resolution, [&](size_t row) {
+            int y = (int)(row % resolution), z = (int)(row / resolution);
+            for (int x = 0; x < resolution; ++x) {
+                glm::vec3 centre = origin + (glm::vec3(x, y, z) + 0.5f) * cellSize;
+                centreDistance[row * resolution + x] = de(centre, frame.objectRotation);
+            }
+        });
+
+        // cells whose bound stays above the refine distance everywhere never need the fine samples
+        float refineDistance = view().refineDistance;
+        float halfDiagonal = 0.8660254f * cellSize;
+        int count = 0;
+        for (size_t i = 0; i < cells; ++i) {
+            if (centreDistance[i] - halfDiagonal < refineDistance) brickIndex[i] = count++;
+        }
+
+        bricks.assign((size_t)count * cBrickSampleCount, 0.0f);
+        std::vector<uint32_t> brickCell(count);
+        for (size_t i = 0; i < cells; ++i) {
+            if (brickIndex[i] >= 0) brickCell[brickIndex[i]] = (uint32_t)i;
+        }
+        float sampleSpacing = cellSize / (float)cBrickCells;
+        theThreadPool.parallelFor((size_t)count, [&](size_t brick) {
+            uint32_t cell = brickCell[brick];
+            glm::vec3 corner = origin + glm::vec3(cell % resolution, (cell / resolution) % resolution, cell / resolution / resolution) * cellSize;
+            float* samples = bricks.data() + brick * cBrickSampleCount;
+            for (int z = 0; z < cBrickSamples; ++z)
+                for (int y = 0; y < cBrickSamples; ++y)
+                    for (int x = 0; x < cBrickSamples; ++x)
+                        *samples++ = de(corner + glm::vec3(x, y, z) * sampleSpacing, frame.objectRotation);
+        });
+    });
+
+    auto end = std::chrono::high_resolution_clock::now();
+    buildTime = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void BrickMapCache::clear()
+{
+    key = 0;
+    centreDistance.clear();
+    centreDistance.shrink_to_fit();
+    brickIndex.clear();
+    brickIndex.shrink_to_fit();
+    bricks.clear();
+    bricks.shrink_to_fit();
+}
+
+std::filesystem::path BrickMapCache::filePath(const std::filesystem::path& directory, const FrameConstants& frame) const
+{
+    return directory / brickMapFileName(brickMapKey(frame), resolution);
+}
+
+bool BrickMapCache::save(const std::filesystem::path& directory) const
+{
+    if (centreDistance.empty()) return false;
+
+    BrickMapFileHeader header;
+    header.key = key;
+    header.resolution = resolution;
+    header.extent = extent;
+    header.brickCount = (uint32_t)brickCount();
+
+    std::ofstream file(directory / brickMapFileName(key, resolution), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(centreDistance.data()), centreDistance.size() * sizeof(float));
+    file.write(reinterpret_cast<const char*>(brickIndex.data()), brickIndex.size() * sizeof(int));
+    file.write(reinterpret_cast<const char*>(bricks.data()), bricks.size() * sizeof(float));
+    return file.good();
+}
+
+bool BrickMapCache::load(const std::filesystem::path& directory, const FrameConstants& frame)
+{
+    std::ifstream file(filePath(directory, frame), std::ios::binary);
+    if (!file.is_open()) return false;
+
+    BrickMapFileHeader header, expected;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version ||
+        header.key != brickMapKey(frame) || header.resolution != resolution || header.brickCells != cBrickCells) return false;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t cells = (size_t)resolution * resolution * resolution;
+    centreDistance.resize(cells);
+    brickIndex.resize(cells);
+    bricks.resize((size_t)header.brickCount * cBrickSampleCount);
+    file.read(reinterpret_cast<char*>(centreDistance.data()), centreDistance.size() * sizeof(float));
+    file.read(reinterpret_cast<char*>(brickIndex.data()), brickIndex.size() * sizeof(int));
+    file.read(reinterpret_cast<char*>(bricks.data()), bricks.size() * sizeof(float));
+    // the indices are used unchecked by brickMapBound on both backends, a corrupted file must not point past the bricks
+    bool indicesValid = std::all_of(brickIndex.begin(), brickIndex.end(), [&header](int index) { return index >= -1 && index < (int64_t)header.brickCount; });
+    if (!file || !indicesValid) {
+        clear();
+        return false;
+    }
+    key = header.key;
+    extent = header.extent;
+    auto end = std::chrono::high_resolution_clock::now();
+    buildTime = std::chrono::duration<double, std::milli>(end - start).count();
+    return true;
+}
+
+BrickMapView BrickMapCache::view() const
+{
+    BrickMapView map = {};
+    map.cellSize = 2.0f * extent / (float)resolution;
+    map.origin = glm::vec3(-extent);
+    map.resolution = centreDistance.empty() ? 0 : resolution;
+    // two fine cells: the bound of a fine cell is at most that far below the estimate
+    map.refineDistance = 2.0f * map.cellSize / (float)cBrickCells;
+    map.centreDistance = centreDistance.data();
+    map.brickIndex = brickIndex.data();
+    map.bricks = bricks.data();
+    return map;
+}
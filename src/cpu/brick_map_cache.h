@@ -0,0 +1,47 @@
+#ifndef BRICK_MAP_CACHE_H
+#define BRICK_MAP_CACHE_H
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include "fractal/brick_map.h"
+
+// Host side storage of the sparse brick map (see fractal/brick_map.h).
+// The map is built on theThreadPool for one fractal (parameters and objectRotation, see brickMapKey) and kept
+// until the fractal changes. Built maps can be saved to and loaded from a directory, one file per key
+class BrickMapCache {
+public:
+    // coarse cells per edge of the grid, the fine resolution is resolution * cBrickCells
+    explicit BrickMapCache(int resolution = 32) : resolution(resolution) {}
+
+    // true if the map was built for the fractal of frame
+    bool matches(const FrameConstants& frame) const { return !centreDistance.empty() && key == brickMapKey(frame); }
+    // samples the distance field of frame's fractal, blocks until done
+    void build(const FrameConstants& frame);
+    void clear();
+
+    // file of the map of frame's fractal in directory
+    std::filesystem::path filePath(const std::filesystem::path& directory, const FrameConstants& frame) const;
+    // false if the file could not be written / does not hold a map of this resolution for frame's fractal
+    bool save(const std::filesystem::path& directory) const;
+    bool load(const std::filesystem::path& directory, const FrameConstants& frame);
+
+    // host pointers, resolution 0 if the map is empty
+    BrickMapView view() const;
+    size_t brickCount() const { return bricks.size() / cBrickSampleCount; }
+    size_t memoryBytes() const { return centreDistance.size() * sizeof(float) + brickIndex.size() * sizeof(int) + bricks.size() * sizeof(float); }
+    double buildMilliseconds() const { return buildTime; }
+
+    // everything that changes the distance field: fractal type, its parameters, iterations and objectRotation
+    static uint64_t brickMapKey(const FrameConstants& frame);
+
+private:
+    int resolution;
+    uint64_t key = 0;
+    float extent = 0.0f; // half edge of the grid cube around the origin
+    std::vector<float> centreDistance;
+    std::vector<int> brickIndex;
+    std::vector<float> bricks;
+    double buildTime = 0.0;
+};
+
+#endif//BRICK_MAP_CACHE_H
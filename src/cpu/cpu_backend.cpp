@@ -0,0 +1,438 @@
+#include "cpu/cpu_backend.h"
+#include "cpu/packet_marcher.h"
+#include "fractal/mandelbulb.h"
+#include "fractal/deep_zoom.h"
+#include "fractal/edge_antialiasing.h"
+#include "utility/thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+static constexpr uint32_t cTileSize = 16;
+
+uint32_t cpuImageWidth = 0, cpuImageHeight = 0;
+std::vector<uint32_t> cpuImage;
+std::vector<glm::vec4> cpuAccumulation; // mean of the samples of every pixel for the progressive refinement, same layout as cpuImage
+std::vector<float> cpuConeStart; // result of the cone prepass, one value per cone tile, rows of the frame's tile count
+std::vector<float> cpuEdgeContrast; // edgeContrast of every pixel for the edge-adaptive supersampling, rows of frame.width
+std::vector<float> cpuHitDistance[2]; // per pixel hit distances of this and the previous frame for the reprojection, rows of frame.width
+uint32_t cpuHistoryIndex = 0; // cpuHitDistance[cpuHistoryIndex] is written by the next renderCpu call
+CpuRenderStats cpuRenderStats;
+ReferenceOrbit cpuReferenceOrbit; // orbit of frame.deepReference for the deep zoom path
+BrickMapView cpuBrickMap = {}; // host arrays owned by the caller of setCpuBrickMap
+SimdIsa cpuSimdIsa = detectSimdIsa();
+std::vector<PixelCounters> cpuPixelCounters; // of instrumented frames, rows of frame.width. Allocated by the first one
+
+void allocateCpuImage(uint32_t width, uint32_t height)
+{
+    cpuImageWidth = width;
+    cpuImageHeight = height;
+    cpuImage.assign((size_t)width * height, 0u);
+    cpuAccumulation.assign((size_t)width * height, glm::vec4(0.0f));
+    cpuConeStart.assign((size_t)((width + cConeTileSize - 1) / cConeTileSize) * ((height + cConeTileSize - 1) / cConeTileSize), 0.0f);
+    for (auto& it : cpuHitDistance) it.assign((size_t)width * height, 0.0f);
+    cpuEdgeContrast.assign((size_t)width * height, 0.0f);
+}
+
+void freeCpuImage()
+{
+    cpuImageWidth = cpuImageHeight = 0;
+    cpuImage.clear();
+    cpuImage.shrink_to_fit();
+    cpuAccumulation.clear();
+    cpuAccumulation.shrink_to_fit();
+    cpuConeStart.clear();
+    cpuConeStart.shrink_to_fit();
+    cpuEdgeContrast.clear();
+    cpuEdgeContrast.shrink_to_fit();
+    for (auto& it : cpuHitDistance) {
+        it.clear();
+        it.shrink_to_fit();
+    }
+    cpuPixelCounters.clear();
+    cpuPixelCounters.shrink_to_fit();
+}
+
+const uint32_t* getCpuImage()
+{
+    return cpuImage.data();
+}
+
+void setCpuSimdIsa(SimdIsa isa)
+{
+    cpuSimdIsa = isSimdIsaSupported(isa) ? isa : detectSimdIsa();
+}
+
+SimdIsa getCpuSimdIsa()
+{
+    return cpuSimdIsa;
+}
+
+void setCpuBrickMap(const BrickMapView& map)
+{
+    cpuBrickMap = map;
+}
+
+// Samples of a tile waiting for the packet marcher, marched in full packets of rays of one kind: the ones starting at a
+// reprojected distance, the ones starting at the safe start and the reprojected ones that failed (reprojectionFailed)
+// and are marched again from the safe start. A packet takes as long as its longest march, so one ray of the last two
+// kinds would keep a packet of short reprojected marches stepping, and a failed lane would march its whole packet again
+class PacketQueue {
+public:
+    PacketQueue(MarchPacketFunction marchPacket, int width, const FrameConstants& frame) : marchPacket(marchPacket), width(width), frame(frame) {}
+
+    // queues the ray, its color and hit distance are written to *color and *hitDistance by the march
+    void push(const ray& r, float start, float safeStart, glm::vec4* color, float* hitDistance) {
+        Kind kind = start > safeStart ? Reprojected : Safe;
+        origin = r.origin;
+        lanes[kind][counts[kind]++] = { r.direction, start, safeStart, color, hitDistance };
+        if (counts[kind] == width) march(kind);
+    }
+
+    // marches the rays still queued
+    void flush() {
+        march(Reprojected);
+        march(Safe);
+        march(Retry);
+    }
+
+    uint64_t evaluations = 0; // distance estimates of the marches
+
+private:
+    enum Kind {
+        Reprojected, Safe, Retry, KindCount
+    };
+
+    struct Lane {
+        glm::vec3 direction;
+        float start, safeStart;
+        glm::vec4* color;
+        float* hitDistance;
+    };
+
+    void march(Kind kind) {
+        int count = counts[kind];
+        if (count == 0) return;
+        counts[kind] = 0;
+
+        RayPacket packet;
+        PacketResult result;
+        packet.count = count;
+        packet.originX = origin.x;
+        packet.originY = origin.y;
+        packet.originZ = origin.z;
+        // lanes past the last ray repeat it
+        for (int lane = 0; lane < width; ++lane) {
+            const Lane& l = lanes[kind][std::min(lane, count - 1)];
+            packet.dirX[lane] = l.direction.x;
+            packet.dirY[lane] = l.direction.y;
+            packet.dirZ[lane] = l.direction.z;
+            packet.start[lane] = l.start;
+        }
+        marchPacket(packet, frame, result);
+
+        for (int lane = 0; lane < count; ++lane) {
+            const Lane& l = lanes[kind][lane];
+            evaluations += (uint64_t)result.evaluations[lane];
+            // same fallback as shadeSample
+            if (kind == Reprojected && reprojectionFailed(result.c[lane], l.start, result.hitDistance[lane])) {
+                lanes[Retry][counts[Retry]++] = { l.direction, l.safeStart, l.safeStart, l.color, l.hitDistance };
+                if (counts[Retry] == width) march(Retry);
+                continue;
+            }
+            glm::vec3 normal = glm::vec3(result.normalX[lane], result.normalY[lane], result.normalZ[lane]);
+            *l.color = colorPixel(result.c[lane], normal, frame.normalSurface);
+            *l.hitDistance = result.hitDistance[lane];
+        }
+    }
+
+    MarchPacketFunction marchPacket;
+    int width;
+    const FrameConstants& frame;
+    glm::vec3 origin = glm::vec3(0.0f); // shared by every ray of the frame
+    Lane lanes[KindCount][cMaxPacketWidth];
+    int counts[KindCount] = {};
+};
+
+// marches count samples at the image positions of the packed pixels with the packet marcher, lanes past the last
+// sample repeat it. start is the safe start of each sample. Returns the number of distance estimates
+static uint64_t shadeSamplePackets(MarchPacketFunction marchPacket, int width, const FrameConstants& frame, const glm::vec2* position,
+    const float* start, int count, glm::vec4* color)
+{
+    RayPacket packet;
+    PacketResult result;
+    uint64_t evaluations = 0;
+
+    for (int first = 0; first < count; first += width) {
+        packet.count = std::min(width, count - first);
+        for (int lane = 0; lane < width; ++lane) {
+            int sample = first + std::min(lane, packet.count - 1);
+            ray r = get_image_ray(position[sample].x, position[sample].y, frame);
+            packet.dirX[lane] = r.direction.x;
+            packet.dirY[lane] = r.direction.y;
+            packet.dirZ[lane] = r.direction.z;
+            packet.start[lane] = start[sample];
+            packet.originX = r.origin.x;
+            packet.originY = r.origin.y;
+            packet.originZ = r.origin.z;
+        }
+        marchPacket(packet, frame, result);
+        for (int lane = 0; lane < packet.count; ++lane) {
+            evaluations += (uint64_t)result.evaluations[lane];
+            glm::vec3 normal = glm::vec3(result.normalX[lane], result.normalY[lane], result.normalZ[lane]);
+            color[first + lane] = colorPixel(result.c[lane], normal, frame.normalSurface);
+        }
+    }
+    return evaluations;
+}
+
+// writes the samples of one row to the image, see cRefinementSubsets for the progressive passes.
+// hitDistance is this frame's hit distance image, only written by full frames and by pass 0
+static void storeSamples(const FrameConstants& frame, uint32_t y, uint32_t x0, uint32_t step, uint32_t count,
+    const glm::vec4* color, const float* sampleHitDistance, float* hitDistance)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t x = x0 + i * step;
+        size_t pixel = (size_t)y * cpuImageWidth + x;
+        if (!frame.progressive) {
+            cpuImage[pixel] = rgbaFloatToInt(color[i]);
+            hitDistance[(size_t)y * frame.width + x] = sampleHitDistance[i];
+        } else if (frame.refinementPass >= cRefinementSubsets) {
+            cpuAccumulation[pixel] = accumulateSample(cpuAccumulation[pixel], color[i], frame.refinementPass);
+            cpuImage[pixel] = rgbaFloatToInt(cpuAccumulation[pixel]);
+        } else if (frame.refinementPass > 0) {
+            cpuAccumulation[pixel] = color[i];
+            cpuImage[pixel] = rgbaFloatToInt(color[i]);
+        } else {
+            // pass 0 shades the top left pixel of every block and fills the whole block with it
+            for (uint32_t by = y; by < std::min(y + 2, frame.height); ++by) {
+                for (uint32_t bx = x; bx < std::min(x + 2, frame.width); ++bx) {
+                    cpuAccumulation[(size_t)by * cpuImageWidth + bx] = color[i];
+                    cpuImage[(size_t)by * cpuImageWidth + bx] = rgbaFloatToInt(color[i]);
+                    hitDistance[(size_t)by * frame.width + bx] = sampleHitDistance[i];
+                }
+            }
+        }
+    }
+}
+
+// cone prepass for one row of cone tiles, in packets like the pixels
+static void coneMarchRow(ConeMarchPacketFunction coneMarchPacket, int width, uint32_t tileY, uint32_t tilesX, const FrameConstants& frame)
+{
+    float* start = cpuConeStart.data() + (size_t)tileY * tilesX;
+    ConePacket cones;
+
+    for (uint32_t tileX = 0; tileX < tilesX; tileX += width) {
+        cones.axes.count = (int)std::min<uint32_t>(width, tilesX - tileX);
+        for (int lane = 0; lane < width; ++lane) {
+            ray axis = coneAxis(tileX + (uint32_t)std::min(lane, cones.axes.count - 1), tileY, frame, &cones.tanHalfAngle[lane]);
+            cones.axes.dirX[lane] = axis.direction.x;
+            cones.axes.dirY[lane] = axis.direction.y;
+            cones.axes.dirZ[lane] = axis.direction.z;
+            cones.axes.originX = axis.origin.x;
+            cones.axes.originY = axis.origin.y;
+            cones.axes.originZ = axis.origin.z;
+        }
+        coneMarchPacket(cones, frame, start + tileX);
+    }
+}
+
+CpuRenderStats getCpuRenderStats()
+{
+    return cpuRenderStats;
+}
+
+const PixelCounters* getCpuPixelCounters()
+{
+    return cpuPixelCounters.data();
+}
+
+void renderCpu(const FrameConstants& frame)
+{
+    if (cpuImage.empty() || frame.width > cpuImageWidth || frame.height > cpuImageHeight) return;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    uint32_t tilesX = (frame.width + cTileSize - 1) / cTileSize;
+    uint32_t tilesY = (frame.height + cTileSize - 1) / cTileSize;
+    uint32_t coneTilesX = (frame.width + cConeTileSize - 1) / cConeTileSize;
+    uint32_t coneTilesY = (frame.height + cConeTileSize - 1) / cConeTileSize;
+    SimdIsa isa = cpuSimdIsa;
+    // the packets only march the float path of the Mandelbulb without the brick map and do not count
+    bool brickMap = frame.brickMap && cpuBrickMap.resolution > 0;
+    bool mandelbulb = frame.fractal.type == FractalType::Mandelbulb;
+    MarchPacketFunction marchPacket = !mandelbulb || frame.deepZoom || brickMap || frame.instrumentation ? nullptr : getPacketMarcher(isa);
+    ConeMarchPacketFunction coneMarchPacket = mandelbulb ? getConePacketMarcher(isa) : nullptr;
+    int width = packetWidth(isa);
+    const float* history = frame.reprojection ? cpuHitDistance[cpuHistoryIndex ^ 1].data() : nullptr;
+    float* hitDistance = cpuHitDistance[cpuHistoryIndex].data();
+    if (frame.instrumentation) cpuPixelCounters.resize((size_t)cpuImageWidth * cpuImageHeight);
+
+    // the pixels shaded by this frame: every step-th row and column from offset, moved by jitter
+    uint32_t step = 1;
+    glm::uvec2 offset = glm::uvec2(0);
+    glm::vec2 jitter = glm::vec2(0.0f);
+    if (frame.progressive && frame.refinementPass < cRefinementSubsets) {
+        step = 2;
+        offset = refinementOffset(frame.refinementPass);
+    } else if (frame.progressive) {
+        jitter = refinementJitter(frame.refinementPass);
+    }
+
+    // distance estimates of the pixel marches, summed per tile
+    std::atomic<uint64_t> evaluations = 0;
+    bool edgeAntialiasing = frame.edgeSamples > 0 && !frame.progressive;
+    std::atomic<uint32_t> edgePixels = 0;
+
+    // the scalar path is instantiated per distance estimator like the CUDA kernel
+    auto render = [&](auto de) {
+        // the cone prepass finishes before the pixels start, like the ConePrepass kernel
+        if (frame.conePrepass) {
+            theThreadPool.parallelFor(coneTilesY, [&](size_t tileY) {
+                if (coneMarchPacket) {
+                    coneMarchRow(coneMarchPacket, width, (uint32_t)tileY, coneTilesX, frame);
+                    return;
+                }
+                for (uint32_t tileX = 0; tileX < coneTilesX; ++tileX)
+                    cpuConeStart[tileY * coneTilesX + tileX] = coneMarch(tileX, (uint32_t)tileY, frame, de);
+            });
+        }
+
+        theThreadPool.parallelFor((size_t)tilesX * tilesY, [&](size_t tile) {
+            uint32_t x0 = (uint32_t)(tile % tilesX) * cTileSize;
+            uint32_t y0 = (uint32_t)(tile / tilesX) * cTileSize;
+            uint32_t x1 = std::min(x0 + cTileSize, frame.width);
+            uint32_t y1 = std::min(y0 + cTileSize, frame.height);
+
+            // tiles have an even size, so the 2x2 blocks of the progressive passes never cross them
+            // the samples of the tile's rows, the packets take them from any row
+            glm::vec4 color[cTileSize][cTileSize];
+            float sampleHitDistance[cTileSize][cTileSize];
+            uint32_t xs = x0 + offset.x;
+            if (xs >= x1) return;
+            uint32_t count = (x1 - xs + step - 1) / step;
+            uint64_t tileEvaluations = 0;
+            PacketQueue queue(marchPacket, width, frame);
+
+            for (uint32_t y = y0 + offset.y; y < y1; y += step) {
+                const float* coneStart = frame.conePrepass ? cpuConeStart.data() + (size_t)(y / cConeTileSize) * coneTilesX : nullptr;
+                uint32_t row = y - y0;
+                if (marchPacket) {
+                    for (uint32_t i = 0; i < count; ++i) {
+                        uint32_t x = xs + i * step;
+                        ray r = get_image_ray((float)x + jitter.x, (float)y + jitter.y, frame);
+                        float safeStart = coneStart ? coneStart[x / cConeTileSize] : 0.0f;
+                        float start = std::max(safeStart, history ? reprojectStart(r.direction, frame, history) : 0.0f);
+                        queue.push(r, start, safeStart, &color[row][i], &sampleHitDistance[row][i]);
+                    }
+                } else {
+                    for (uint32_t i = 0; i < count; ++i) {
+                        uint32_t x = xs + i * step;
+                        int sampleEvaluations;
+                        float start = coneStart ? coneStart[x / cConeTileSize] : 0.0f;
+                        if (frame.instrumentation) {
+                            PixelCounters& counters = cpuPixelCounters[(size_t)y * frame.width + x];
+                            color[row][i] = shadeInstrumentedSample((float)x + jitter.x, (float)y + jitter.y, frame, de, &counters, start,
+                                history, &sampleHitDistance[row][i], &sampleEvaluations);
+                            if (frame.heatmap) color[row][i] = heatmapColor(counters, frame, color[row][i]);
+                        } else {
+                            color[row][i] = shadeSample((float)x + jitter.x, (float)y + jitter.y, frame, de, start, history, &sampleHitDistance[row][i],
+                                &sampleEvaluations);
+                        }
+                        tileEvaluations += (uint64_t)sampleEvaluations;
+                    }
+                }
+            }
+            if (marchPacket) {
+                queue.flush();
+                tileEvaluations += queue.evaluations;
+            }
+            for (uint32_t y = y0 + offset.y; y < y1; y += step) storeSamples(frame, y, xs, step, count, color[y - y0], sampleHitDistance[y - y0], hitDistance);
+            evaluations += tileEvaluations;
+        });
+        if (!edgeAntialiasing) return;
+
+        // edge-adaptive supersampling, see fractal/edge_antialiasing.h. The contrast pass reads the primary image only
+        std::atomic<unsigned int> histogram[cEdgeHistogramBins] = {};
+        auto texel = [](uint32_t x, uint32_t y) { return cpuImage[(size_t)y * cpuImageWidth + x]; };
+        theThreadPool.parallelFor(frame.height, [&](size_t y) {
+            unsigned int rowHistogram[cEdgeHistogramBins] = {};
+            for (uint32_t x = 0; x < frame.width; ++x) {
+                float contrast = edgeContrast(x, (uint32_t)y, frame, texel, hitDistance);
+                cpuEdgeContrast[y * frame.width + x] = contrast;
+                if (contrast > frame.edgeThreshold) ++rowHistogram[edgeHistogramBin(contrast, frame)];
+            }
+            for (int bin = 0; bin < cEdgeHistogramBins; ++bin) histogram[bin] += rowHistogram[bin];
+        });
+        unsigned int counts[cEdgeHistogramBins];
+        for (int bin = 0; bin < cEdgeHistogramBins; ++bin) counts[bin] = histogram[bin];
+        int cutoffBin = edgeCutoffBin(counts, frame);
+
+        theThreadPool.parallelFor((size_t)tilesX * tilesY, [&](size_t tile) {
+            uint32_t x0 = (uint32_t)(tile % tilesX) * cTileSize;
+            uint32_t y0 = (uint32_t)(tile / tilesX) * cTileSize;
+            uint32_t x1 = std::min(x0 + cTileSize, frame.width);
+            uint32_t y1 = std::min(y0 + cTileSize, frame.height);
+            // the extra samples of the edge pixels of the tile, edgeSamples per pixel. Marched together, the packets stay full
+            std::vector<uint32_t> pixels;
+            std::vector<glm::vec2> position;
+            std::vector<float> start;
+            for (uint32_t y = y0; y < y1; ++y) {
+                for (uint32_t x = x0; x < x1; ++x) {
+                    if (!isRefinedEdge(cpuEdgeContrast[(size_t)y * frame.width + x], cutoffBin, frame)) continue;
+                    pixels.push_back(y * cpuImageWidth + x);
+                    float pixelStart = frame.conePrepass ? cpuConeStart[(y / cConeTileSize) * coneTilesX + x / cConeTileSize] : 0.0f;
+                    for (uint32_t i = 1; i <= frame.edgeSamples; ++i) {
+                        position.push_back(glm::vec2((float)x, (float)y) + edgeSampleJitter(i));
+                        start.push_back(pixelStart);
+                    }
+                }
+            }
+            if (pixels.empty()) return;
+
+            std::vector<glm::vec4> color(position.size());
+            uint64_t tileEvaluations = 0;
+            if (marchPacket) {
+                tileEvaluations = shadeSamplePackets(marchPacket, width, frame, position.data(), start.data(), (int)position.size(), color.data());
+            } else {
+                for (size_t i = 0; i < position.size(); ++i) {
+                    int sampleEvaluations;
+                    color[i] = shadeSample(position[i].x, position[i].y, frame, de, start[i], nullptr, nullptr, &sampleEvaluations);
+                    tileEvaluations += (uint64_t)sampleEvaluations;
+                }
+            }
+            for (size_t p = 0; p < pixels.size(); ++p) {
+                glm::vec4 sum = rgbaIntToFloat(cpuImage[pixels[p]]);
+                for (uint32_t i = 0; i < frame.edgeSamples; ++i) sum += color[p * frame.edgeSamples + i];
+                cpuImage[pixels[p]] = rgbaFloatToInt(sum / (float)(frame.edgeSamples + 1));
+            }
+            evaluations += tileEvaluations;
+            edgePixels += (uint32_t)pixels.size();
+        });
+    };
+    if (frame.deepZoom) {
+        computeReferenceOrbit(frame, cpuReferenceOrbit);
+        render(PerturbedMandelbulb{ &cpuReferenceOrbit, frame.fractal, frame.fractal.minDistance });
+    } else if (brickMap) {
+        // only the generic estimators, the specialized ones are about as fast as the lookups (see fractal/brick_map.h)
+        dispatchGenericEstimator(frame.fractal, [&](auto de) { render(CachedDistanceEstimator<decltype(de)>{ de, cpuBrickMap }); });
+    } else {
+        dispatchDistanceEstimator(frame.fractal, render);
+    }
+
+    cpuHistoryIndex ^= 1;
+
+    auto end = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    cpuRenderStats.milliseconds = seconds * 1e3;
+    double shaded = (double)((frame.width - offset.x + step - 1) / step) * ((frame.height - offset.y + step - 1) / step);
+    cpuRenderStats.megapixelsPerSecond = seconds > 0.0 ? shaded / seconds / 1e6 : 0.0;
+    double samples = shaded + (double)edgePixels * frame.edgeSamples;
+    cpuRenderStats.stepsPerSample = samples > 0.0 ? (double)evaluations / samples : 0.0;
+    cpuRenderStats.edgePixels = edgePixels;
+    cpuRenderStats.tileCount = tilesX * tilesY;
+    cpuRenderStats.threadCount = theThreadPool.threadCount();
+    cpuRenderStats.isa = isa;
+}
@@ -0,0 +1,45 @@
+#ifndef CPU_BACKEND_H
+#define CPU_BACKEND_H
+#include <cstdint>
+#include "cpu/cpu_features.h"
+#include "fractal/frame_constants.h"
+#include "fractal/brick_map.h"
+#include "fractal/pixel_counters.h"
+
+// CPU counterpart of the CUDA interop backend (see cuda/interop.cuh).
+// The image is split into tiles which are shaded in parallel on theThreadPool with the same fractal code as the kernel.
+// The result is a host side R8G8B8A8 image, the renderer uploads it to the vulkan image.
+
+struct CpuRenderStats {
+    double milliseconds = 0.0;
+    double megapixelsPerSecond = 0.0;
+    // distance estimates per shaded sample taken by the pixel marches, without the cone prepass and the normals.
+    // The packet marcher stops rays leaving the escape radius early, its counts can be lower than the scalar ones
+    double stepsPerSample = 0.0;
+    // pixels that got the extra samples of the edge-adaptive supersampling
+    uint32_t edgePixels = 0;
+    uint32_t tileCount = 0;
+    uint32_t threadCount = 0;
+    SimdIsa isa = SimdIsa::Scalar;
+};
+
+// allocates the host side image. Must be called before renderCpu and again when the size changes
+void allocateCpuImage(uint32_t width, uint32_t height);
+void freeCpuImage();
+// the image written by the last renderCpu call, width * height packed R8G8B8A8 texels (allocateCpuImage size).
+// Frames smaller than that fill its top left corner, rows keep the full width
+const uint32_t* getCpuImage();
+// same as renderCuda, blocks until the frame is finished. frame.width/height must not exceed allocateCpuImage
+void renderCpu(const FrameConstants& frame);
+// instruction set of the packet marcher, defaults to detectSimdIsa(). Unsupported sets fall back to the widest supported one
+void setCpuSimdIsa(SimdIsa isa);
+SimdIsa getCpuSimdIsa();
+// brick map for the frames with brickMap set, the arrays must stay alive until it is replaced. resolution 0 removes it
+void setCpuBrickMap(const BrickMapView& map);
+// timing of the last renderCpu call
+CpuRenderStats getCpuRenderStats();
+// counters of the last frame with instrumentation set, frame.width * frame.height of it in rows of frame.width.
+// Empty before the first one
+const PixelCounters* getCpuPixelCounters();
+
+#endif//CPU_BACKEND_H
@@ -0,0 +1,68 @@
+#include "cpu/cpu_features.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+// cpuid alone is not enough: the OS must also save the ymm/zmm registers on context switches (XCR0)
+static bool msvcSupports(SimdIsa isa)
+{
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    if (!osxsave) return false;
+    unsigned long long xcr0 = _xgetbv(0);
+
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    bool avx512f = (info[1] & (1 << 16)) != 0;
+
+    bool ymmState = (xcr0 & 0x6) == 0x6;
+    bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+    switch (isa) {
+    case SimdIsa::Avx2: return avx2 && fma && ymmState;
+    case SimdIsa::Avx512: return avx512f && zmmState;
+    default: return true;
+    }
+}
+#endif
+
+bool isSimdIsaSupported(SimdIsa isa)
+{
+    if (isa == SimdIsa::Scalar) return true;
+#if defined(_MSC_VER)
+    return msvcSupports(isa);
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    switch (isa) {
+    case SimdIsa::Avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case SimdIsa::Avx512: return __builtin_cpu_supports("avx512f");
+    default: return false;
+    }
+#else
+    return false;
+#endif
+}
+
+SimdIsa detectSimdIsa()
+{
+    if (isSimdIsaSupported(SimdIsa::Avx512)) return SimdIsa::Avx512;
+    if (isSimdIsaSupported(SimdIsa::Avx2)) return SimdIsa::Avx2;
+    return SimdIsa::Scalar;
+}
+
+const char* toString(SimdIsa isa)
+{
+    switch (isa) {
+    case SimdIsa::Scalar: return "Scalar";
+    case SimdIsa::Avx2: return "AVX2";
+    case SimdIsa::Avx512: return "AVX-512";
+    }
+    return "Unknown";
+}
@@ -0,0 +1,15 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// instruction sets the packet ray marcher is compiled for, ordered by width
+enum class SimdIsa : int {
+    Scalar, Avx2, Avx512
+};
+
+// widest instruction set supported by both the processor and the operating system
+SimdIsa detectSimdIsa();
+// true if isa can be executed on this machine
+bool isSimdIsaSupported(SimdIsa isa);
+const char* toString(SimdIsa isa);
+
+#endif//CPU_FEATURES_H
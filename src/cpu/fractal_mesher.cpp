@@ -0,0 +1,185 @@
+#include "cpu/fractal_mesher.h"
+#include "fractal/mandelbulb.h"
+#include "utility/thread_pool.h"
+#include <chrono>
+#include <cstdio>
+
+// corners of a cell, bit i of the index is the offset along axis i
+static constexpr int cCellEdges[12][2] = {
+    { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 }, // along x
+    { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 }, // along y
+    { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }, // along z
+};
+
+// Meshes one chunk. The samples reach one point past the chunk so the cells on its upper faces get their vertices too,
+// every chunk emits the quads of the edges whose perpendicular coordinates lie in [1, n]: together the chunks cover
+// every edge of the cube except the ones on its lower faces, which lie outside the bounding sphere
+template <typename DE>
+static void meshChunk(glm::ivec3 chunk, int n, glm::vec3 origin, float cellSize, float iso, const glm::mat3& rotation, const DE& de, FractalMeshChunk& out)
+{
+    out.vertices.clear();
+    out.indices.clear();
+
+    int samples = n + 2;
+    std::vector<float> field((size_t)samples * samples * samples);
+    auto sample = [&](glm::ivec3 p) -> float& { return field[((size_t)p.z * samples + p.y) * samples + p.x]; };
+    // positions from global indices, the chunks sharing a cell compute bit identical vertices for it
+    glm::ivec3 base = chunk * n;
+    auto position = [&](glm::ivec3 local) { return origin + glm::vec3(base + local) * cellSize; };
+    for (int z = 0; z < samples; ++z)
+        for (int y = 0; y < samples; ++y)
+            for (int x = 0; x < samples; ++x)
+                sample({ x, y, z }) = de(position({ x, y, z }), rotation) - iso;
+
+    int cells = n + 1;
+    std::vector<int> cellVertex((size_t)cells * cells * cells, -1);
+    auto vertexOf = [&](glm::ivec3 c) -> int& { return cellVertex[((size_t)c.z * cells + c.y) * cells + c.x]; };
+    for (int z = 0; z < cells; ++z) {
+        for (int y = 0; y < cells; ++y) {
+            for (int x = 0; x < cells; ++x) {
+                glm::ivec3 cell = { x, y, z };
+                float values[8];
+                int inside = 0;
+                for (int i = 0; i < 8; ++i) {
+                    values[i] = sample(cell + glm::ivec3(i & 1, (i >> 1) & 1, i >> 2));
+                    inside += values[i] < 0.0f;
+                }
+                if (inside == 0 || inside == 8) continue;
+
+                glm::vec3 mass = glm::vec3(0.0f);
+                int crossings = 0;
+                for (auto& edge : cCellEdges) {
+                    float v0 = values[edge[0]], v1 = values[edge[1]];
+                    if ((v0 < 0.0f) == (v1 < 0.0f)) continue;
+                    glm::vec3 c0 = glm::vec3(edge[0] & 1, (edge[0] >> 1) & 1, edge[0] >> 2);
+                    glm::vec3 c1 = glm::vec3(edge[1] & 1, (edge[1] >> 1) & 1, edge[1] >> 2);
+                    mass += c0 + (c1 - c0) * (v0 / (v0 - v1));
+                    ++crossings;
+                }
+
+                // one Newton step onto the surface along the gradient, kept in the cell so the quads do not fold
+                glm::vec3 lower = position(cell);
+                glm::vec3 p = lower + mass / (float)crossings * cellSize;
+                glm::vec3 gradient = de.gradient(p, rotation);
+                float length2 = glm::dot(gradient, gradient);
+                if (length2 > 0.0f) {
+                    p = glm::clamp(p - gradient * ((de(p, rotation) - iso) / length2), lower, lower + cellSize);
+                    glm::vec3 surfaceGradient = de.gradient(p, rotation);
+                    if (glm::dot(surfaceGradient, surfaceGradient) > 0.0f) gradient = surfaceGradient;
+                }
+
+                vertexOf(cell) = (int)out.vertices.size();
+                out.vertices.push_back({ p, length2 > 0.0f ? glm::normalize(gradient) : glm::vec3(0.0f) });
+            }
+        }
+    }
+
+    for (int a = 0; a < 3; ++a) {
+        int b = (a + 1) % 3, c = (a + 2) % 3;
+        glm::ivec3 ea = glm::ivec3(0), eb = glm::ivec3(0), ec = glm::ivec3(0);
+        ea[a] = eb[b] = ec[c] = 1;
+        glm::ivec3 p;
+        for (p[c] = 1; p[c] <= n; ++p[c]) {
+            for (p[b] = 1; p[b] <= n; ++p[b]) {
+                for (p[a] = 0; p[a] < n; ++p[a]) {
+                    bool inside = sample(p) < 0.0f;
+                    if (inside == (sample(p + ea) < 0.0f)) continue;
+                    // the four cells around the edge, counter clockwise in the b-c plane seen from +a
+                    uint32_t quad[4] = { (uint32_t)vertexOf(p - eb - ec), (uint32_t)vertexOf(p - ec), (uint32_t)vertexOf(p), (uint32_t)vertexOf(p - eb) };
+                    // the surface faces the outside end of the edge
+                    if (!inside) std::swap(quad[1], quad[3]);
+                    out.indices.insert(out.indices.end(), { quad[0], quad[1], quad[2], quad[0], quad[2], quad[3] });
+                }
+            }
+        }
+    }
+}
+
+FractalMeshStats extractFractalMesh(const FrameConstants& frame, const FractalMeshSettings& settings, const std::function<void(const FractalMeshChunk&)>& sink,
+    FractalMeshProgress* progress)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    FractalMeshStats stats;
+
+    int n = std::max(settings.chunkCells, 1);
+    int chunksPerEdge = std::max((settings.resolution + n - 1) / n, 1);
+    float bound = fractalBoundingRadius(frame.fractal);
+    float extent = bound > 0.0f ? bound : 2.0f;
+    float cellSize = 2.0f * extent / (float)(chunksPerEdge * n);
+    glm::vec3 origin = glm::vec3(-extent);
+    float iso = settings.isoLevel > 0.0f ? settings.isoLevel : 0.5f * cellSize;
+
+    dispatchDistanceEstimator(frame.fractal, [&](auto de) {
+        // octree over the chunks: a node is empty if the estimate at its centre exceeds its half diagonal, with a margin
+        // for the samples and vertices reaching past the chunks
+        std::vector<glm::ivec3> chunks;
+        int rootSize = 1;
+        while (rootSize < chunksPerEdge) rootSize *= 2;
+        auto visit = [&](auto& self, glm::ivec3 lower, int size) -> void {
+            glm::ivec3 upper = glm::min(lower + size, glm::ivec3(chunksPerEdge));
+            glm::vec3 low = origin + glm::vec3(lower * n) * cellSize, high = origin + glm::vec3(upper * n) * cellSize;
+            if (de(0.5f * (low + high), frame.objectRotation) - iso > 0.5f * glm::length(high - low) + 2.0f * cellSize) {
+                glm::ivec3 extentInChunks = upper - lower;
+                stats.emptyChunks += (size_t)extentInChunks.x * extentInChunks.y * extentInChunks.z;
+                return;
+            }
+            if (size == 1) {
+                chunks.push_back(lower);
+                return;
+            }
+            int half = size / 2;
+            for (int i = 0; i < 8; ++i) {
+                glm::ivec3 child = lower + glm::ivec3(i & 1, (i >> 1) & 1, i >> 2) * half;
+                if (child.x < chunksPerEdge && child.y < chunksPerEdge && child.z < chunksPerEdge) self(self, child, half);
+            }
+        };
+        visit(visit, glm::ivec3(0), rootSize);
+        stats.chunks = chunks.size();
+        if (progress) progress->chunkCount = chunks.size();
+
+        size_t batchSize = settings.chunksPerBatch > 0 ? (size_t)settings.chunksPerBatch : 4 * (size_t)theThreadPool.threadCount();
+        std::vector<FractalMeshChunk> batch(std::min(batchSize, chunks.size()));
+        for (size_t first = 0; first < chunks.size() && !(progress && progress->cancel); first += batchSize) {
+            size_t count = std::min(batchSize, chunks.size() - first);
+            theThreadPool.parallelFor(count, [&](size_t i) {
+                meshChunk(chunks[first + i], n, origin, cellSize, iso, frame.objectRotation, de, batch[i]);
+            });
+            for (size_t i = 0; i < count; ++i) {
+                if (batch[i].indices.empty()) continue;
+                stats.vertices += batch[i].vertices.size();
+                stats.triangles += batch[i].indices.size() / 3;
+                sink(batch[i]);
+            }
+            if (progress) progress->chunksDone += count;
+        }
+    });
+
+    auto end = std::chrono::high_resolution_clock::now();
+    stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    return stats;
+}
+
+bool writeFractalMeshObj(const std::filesystem::path& path, const FrameConstants& frame, const FractalMeshSettings& settings, FractalMeshStats* stats,
+    FractalMeshProgress* progress)
+{
+    FILE* file = fopen(path.string().c_str(), "w");
+    if (!file) return false;
+
+    fprintf(file, "# %s power %g, %d iterations, %d^3 cells\n", toString(frame.fractal.type), frame.fractal.power, frame.fractal.iterations, settings.resolution);
+    size_t written = 0; // OBJ indices are global and 1 based
+    FractalMeshStats result = extractFractalMesh(frame, settings, [&](const FractalMeshChunk& chunk) {
+        for (auto& v : chunk.vertices) fprintf(file, "v %.7g %.7g %.7g\n", v.position.x, v.position.y, v.position.z);
+        for (auto& v : chunk.vertices) fprintf(file, "vn %.4f %.4f %.4f\n", v.normal.x, v.normal.y, v.normal.z);
+        for (size_t i = 0; i < chunk.indices.size(); i += 3) {
+            size_t a = written + chunk.indices[i] + 1, b = written + chunk.indices[i + 1] + 1, c = written + chunk.indices[i + 2] + 1;
+            fprintf(file, "f %zu//%zu %zu//%zu %zu//%zu\n", a, a, b, b, c, c);
+        }
+        written += chunk.vertices.size();
+    }, progress);
+    bool ok = ferror(file) == 0 && !(progress && progress->cancel);
+    ok = fclose(file) == 0 && ok;
+    std::error_code error;
+    if (progress && progress->cancel) std::filesystem::remove(path, error); // no half written mesh
+    if (stats) *stats = result;
+    return ok;
+}
@@ -0,0 +1,60 @@
+#ifndef FRACTAL_MESHER_H
+#define FRACTAL_MESHER_H
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <vector>
+#include "fractal/frame_constants.h"
+
+// Triangle mesh of the fractal surface for export.
+// The cube around the bounding sphere is split into chunks of chunkCells^3 cells. An octree over the chunks drops the
+// ones the distance estimate proves empty, the others are meshed in parallel on theThreadPool with dual contouring:
+// one vertex per cell the surface crosses, at the mean of the edge crossings projected onto the surface along the
+// gradient, and one quad per crossed edge. Chunks are handed to the caller in batches, only one batch is in memory
+
+struct FractalMeshSettings {
+    // cells per edge of the cube, rounded up to a multiple of chunkCells
+    int resolution = 256;
+    int chunkCells = 32;
+    // the surface is where the estimate crosses this, 0: half a cell. The estimate is ~0 everywhere inside the set
+    float isoLevel = 0.0f;
+    // chunks meshed before the batch is handed on, 0: 4 per thread
+    int chunksPerBatch = 0;
+};
+
+struct FractalMeshVertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+// indexed triangles of one chunk, indices into its own vertices
+struct FractalMeshChunk {
+    std::vector<FractalMeshVertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+struct FractalMeshStats {
+    size_t chunks = 0; // chunks the octree kept
+    size_t emptyChunks = 0; // chunks it dropped
+    size_t vertices = 0;
+    size_t triangles = 0;
+    double milliseconds = 0.0;
+};
+
+// lets another thread follow and stop an extraction
+struct FractalMeshProgress {
+    std::atomic<size_t> chunkCount = 0; // chunks the octree kept, set once it ran
+    std::atomic<size_t> chunksDone = 0;
+    std::atomic<bool> cancel = false; // ends the extraction before its next batch
+};
+
+// meshes the fractal of frame (fractal parameters and objectRotation) in the coordinates the marcher samples.
+// sink is called on the calling thread for every non empty chunk
+FractalMeshStats extractFractalMesh(const FrameConstants& frame, const FractalMeshSettings& settings, const std::function<void(const FractalMeshChunk&)>& sink,
+    FractalMeshProgress* progress = nullptr);
+// streams the mesh into a Wavefront OBJ file, false if it could not be written or was cancelled
+bool writeFractalMeshObj(const std::filesystem::path& path, const FrameConstants& frame, const FractalMeshSettings& settings, FractalMeshStats* stats = nullptr,
+    FractalMeshProgress* progress = nullptr);
+
+#endif//FRACTAL_MESHER_H
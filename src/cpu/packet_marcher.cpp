@@ -0,0 +1,28 @@
+#include "cpu/packet_marcher.h"
+
+int packetWidth(SimdIsa isa)
+{
+    switch (isa) {
+    case SimdIsa::Avx2: return 8;
+    case SimdIsa::Avx512: return 16;
+    default: return 1;
+    }
+}
+
+MarchPacketFunction getPacketMarcher(SimdIsa isa)
+{
+    switch (isa) {
+    case SimdIsa::Avx2: return &avx2::marchPacket;
+    case SimdIsa::Avx512: return &avx512::marchPacket;
+    default: return nullptr;
+    }
+}
+
+ConeMarchPacketFunction getConePacketMarcher(SimdIsa isa)
+{
+    switch (isa) {
+    case SimdIsa::Avx2: return &avx2::coneMarchPacket;
+    case SimdIsa::Avx512: return &avx512::coneMarchPacket;
+    default: return nullptr;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef CPU_PACKET_MARCHER_H
+#define CPU_PACKET_MARCHER_H
+#include "cpu/cpu_features.h"
+#include "fractal/frame_constants.h"
+
+// Packet (SIMD) version of march() / calculateNormal() from fractal/mandelbulb.h.
+// One packet holds up to 16 rays in structure of arrays layout, every lane marches its own ray;
+// lanes whose ray hit the surface or left the escape radius are masked out until the whole packet is done.
+
+constexpr int cMaxPacketWidth = 16;
+
+struct RayPacket {
+    alignas(64) float dirX[cMaxPacketWidth];
+    alignas(64) float dirY[cMaxPacketWidth];
+    alignas(64) float dirZ[cMaxPacketWidth];
+    alignas(64) float start[cMaxPacketWidth]; // distance the ray skips, the start_dist of march()
+    float originX, originY, originZ; // shared by every ray of the packet
+    int count; // lanes >= count are ignored
+};
+
+struct PacketResult {
+    alignas(64) float c[cMaxPacketWidth]; // value returned by march()
+    alignas(64) float hitDistance[cMaxPacketWidth]; // distance of the hit from the origin, 0 for misses (see shadePixel)
+    alignas(64) float evaluations[cMaxPacketWidth]; // distance estimates taken by the march, for the statistics
+    alignas(64) float normalX[cMaxPacketWidth]; // calculateNormal() at the hit position, only written if frame.normalSurface
+    alignas(64) float normalY[cMaxPacketWidth];
+    alignas(64) float normalZ[cMaxPacketWidth];
+};
+
+// axes of up to 16 cones of the cone prepass, see coneMarch() in fractal/mandelbulb.h
+struct ConePacket {
+    RayPacket axes; // axes.start is ignored
+    alignas(64) float tanHalfAngle[cMaxPacketWidth];
+};
+
+using MarchPacketFunction = void (*)(const RayPacket& packet, const FrameConstants& frame, PacketResult& result);
+// writes the coneMarch() result of the first cones.axes.count cones to start
+using ConeMarchPacketFunction = void (*)(const ConePacket& cones, const FrameConstants& frame, float* start);
+
+// number of rays marched together by isa, 1 for the scalar path
+int packetWidth(SimdIsa isa);
+// nullptr for SimdIsa::Scalar, the caller uses the scalar march() then
+MarchPacketFunction getPacketMarcher(SimdIsa isa);
+// nullptr for SimdIsa::Scalar, the caller uses the scalar coneMarch() then
+ConeMarchPacketFunction getConePacketMarcher(SimdIsa isa);
+
+// implemented in the isa specific translation units, only call them if isSimdIsaSupported
+namespace avx2 {
+    void marchPacket(const RayPacket& packet, const FrameConstants& frame, PacketResult& result);
+    void coneMarchPacket(const ConePacket& cones, const FrameConstants& frame, float* start);
+}
+
+namespace avx512 {
+    void marchPacket(const RayPacket& packet, const FrameConstants& frame, PacketResult& result);
+    void coneMarchPacket(const ConePacket& cones, const FrameConstants& frame, float* start);
+}
+
+#endif//CPU_PACKET_MARCHER_H
@@ -0,0 +1,573 @@
+// Generic packet ray marcher, included by packet_marcher_avx2.cpp and packet_marcher_avx512.cpp
+// inside their isa namespace after they defined vfloat, vint, vmask and the helpers below for their register width:
+//   arithmetic and comparison operators, fmadd, vsqrt, vmin, vmax, vabs, vfloor, select, any, andnot,
+//   vload, vstore, toInt, toFloat, nonzero, vfrexp, vpow2i, firstLanes
+// The mathematical functions are single precision Cephes approximations (a few ulp in the ranges used here),
+// so the packet path matches the scalar march() up to rounding.
+
+// ---------------------------------------------------------------------------------------------------------------------
+// math
+
+static inline vfloat vlog(vfloat x)
+{
+    x = vmax(x, vfloat(1.17549435e-38f)); // log(0) is only reached at the origin, keep it finite
+    vfloat e;
+    vfloat m = vfrexp(x, e); // x = m * 2^e, m in [0.5, 1)
+
+    vmask small = m < vfloat(0.707106781186547524f);
+    e = select(small, e - vfloat(1.0f), e);
+    m = select(small, m + m, m) - vfloat(1.0f);
+
+    vfloat z = m * m;
+    vfloat y = vfloat(7.0376836292E-2f);
+    y = fmadd(y, m, vfloat(-1.1514610310E-1f));
+    y = fmadd(y, m, vfloat(1.1676998740E-1f));
+    y = fmadd(y, m, vfloat(-1.2420140846E-1f));
+    y = fmadd(y, m, vfloat(1.4249322787E-1f));
+    y = fmadd(y, m, vfloat(-1.6668057665E-1f));
+    y = fmadd(y, m, vfloat(2.0000714765E-1f));
+    y = fmadd(y, m, vfloat(-2.4999993993E-1f));
+    y = fmadd(y, m, vfloat(3.3333331174E-1f));
+    y = y * m * z;
+
+    y = fmadd(e, vfloat(-2.12194440e-4f), y);
+    y = fmadd(z, vfloat(-0.5f), y);
+    return fmadd(e, vfloat(0.693359375f), m + y);
+}
+
+static inline vfloat vexp(vfloat x)
+{
+    x = vmin(vmax(x, vfloat(-87.3365447505f)), vfloat(88.3762626647949f));
+
+    // exp(x) = 2^n * exp(g), |g| <= ln(2) / 2
+    vfloat n = vfloor(fmadd(x, vfloat(1.44269504088896341f), vfloat(0.5f)));
+    x = x - n * vfloat(0.693359375f);
+    x = x - n * vfloat(-2.12194440e-4f);
+
+    vfloat z = x * x;
+    vfloat y = vfloat(1.9875691500E-4f);
+    y = fmadd(y, x, vfloat(1.3981999507E-3f));
+    y = fmadd(y, x, vfloat(8.3334519073E-3f));
+    y = fmadd(y, x, vfloat(4.1665795894E-2f));
+    y = fmadd(y, x, vfloat(1.6666665459E-1f));
+    y = fmadd(y, x, vfloat(5.0000001201E-1f));
+    y = fmadd(y, z, x) + vfloat(1.0f);
+
+    return y * vpow2i(toInt(n));
+}
+
+// x^p for x >= 0
+static inline vfloat vpow(vfloat x, float p)
+{
+    return vexp(vlog(x) * vfloat(p));
+}
+
+static inline void vsincos(vfloat x, vfloat& s, vfloat& c)
+{
+    vmask negative = x < vfloat(0.0f);
+    x = vabs(x);
+
+    // octant, rounded up to even
+    vint j = toInt(x * vfloat(1.27323954473516f));
+    j = (j + vint(1)) & vint(~1);
+    vfloat y = toFloat(j);
+
+    vmask polySwap = nonzero(j & vint(2));
+    vmask flipSin = nonzero(j & vint(4));
+    vmask flipCos = !nonzero((j - vint(2)) & vint(4));
+
+    // extended precision modular arithmetic
+    x = fmadd(y, vfloat(-0.78515625f), x);
+    x = fmadd(y, vfloat(-2.4187564849853515625e-4f), x);
+    x = fmadd(y, vfloat(-3.77489497744594108e-8f), x);
+
+    vfloat z = x * x;
+    vfloat cosPoly = vfloat(2.443315711809948E-005f);
+    cosPoly = fmadd(cosPoly, z, vfloat(-1.388731625493765E-003f));
+    cosPoly = fmadd(cosPoly, z, vfloat(4.166664568298827E-002f));
+    cosPoly = cosPoly * z * z;
+    cosPoly = fmadd(z, vfloat(-0.5f), cosPoly) + vfloat(1.0f);
+
+    vfloat sinPoly = vfloat(-1.9515295891E-4f);
+    sinPoly = fmadd(sinPoly, z, vfloat(8.3321608736E-3f));
+    sinPoly = fmadd(sinPoly, z, vfloat(-1.6666654611E-1f));
+    sinPoly = fmadd(sinPoly * z, x, x);
+
+    s = select(polySwap, cosPoly, sinPoly);
+    c = select(polySwap, sinPoly, cosPoly);
+
+    vmask signSin = (negative & !flipSin) | andnot(flipSin, negative);
+    s = select(signSin, -s, s);
+    c = select(flipCos, -c, c);
+}
+
+static inline vfloat vatan(vfloat x)
+{
+    vmask negative = x < vfloat(0.0f);
+    x = vabs(x);
+
+    // range reduction to |x| <= tan(pi / 8)
+    vmask big = x > vfloat(2.414213562373095f);
+    vmask mid = andnot(x > vfloat(0.4142135623730950f), big);
+    vfloat y0 = select(big, vfloat(1.5707963267948966f), select(mid, vfloat(0.7853981633974483f), vfloat(0.0f)));
+    x = select(big, vfloat(-1.0f) / x, select(mid, (x - vfloat(1.0f)) / (x + vfloat(1.0f)), x));
+
+    vfloat z = x * x;
+    vfloat y = vfloat(8.05374449538e-2f);
+    y = fmadd(y, z, vfloat(-1.38776856032E-1f));
+    y = fmadd(y, z, vfloat(1.99777106478E-1f));
+    y = fmadd(y, z, vfloat(-3.33329491539E-1f));
+    y = fmadd(y * z, x, x) + y0;
+
+    return select(negative, -y, y);
+}
+
+static inline vfloat vatan2(vfloat y, vfloat x)
+{
+    vfloat a = vatan(y / x); // x == 0 gives +-inf -> +-pi/2
+    vfloat halfTurn = select(y < vfloat(0.0f), vfloat(-3.14159265358979f), vfloat(3.14159265358979f));
+    a = select(x < vfloat(0.0f), a + halfTurn, a);
+    return select((x == vfloat(0.0f)) & (y == vfloat(0.0f)), vfloat(0.0f), a);
+}
+
+// asin for |x| <= 0.5
+static inline vfloat vasinSmall(vfloat x)
+{
+    vfloat z = x * x;
+    vfloat y = vfloat(4.2163199048E-2f);
+    y = fmadd(y, z, vfloat(2.4181311049E-2f));
+    y = fmadd(y, z, vfloat(4.5470025998E-2f));
+    y = fmadd(y, z, vfloat(7.4953002686E-2f));
+    y = fmadd(y, z, vfloat(1.6666752422E-1f));
+    return fmadd(y * z, x, x);
+}
+
+static inline vfloat vacos(vfloat x)
+{
+    x = vmin(vmax(x, vfloat(-1.0f)), vfloat(1.0f));
+    vmask low = x < vfloat(-0.5f);
+    vmask high = x > vfloat(0.5f);
+
+    vfloat a = vsqrt(vfloat(0.5f) * (vfloat(1.0f) - vabs(x)));
+    vfloat s = vasinSmall(select(low | high, a, x));
+
+    vfloat twoS = s + s;
+    return select(high, twoS, select(low, vfloat(3.14159265358979f) - twoS, vfloat(1.5707963267948966f) - s));
+}
+
+// x^n for n >= 0 by repeated squaring
+static inline vfloat vipow(vfloat x, int n)
+{
+    vfloat result = vfloat(1.0f);
+    while (n > 0) {
+        if (n & 1) result = result * x;
+        x = x * x;
+        n >>= 1;
+    }
+    return result;
+}
+
+// (re + im i)^n for n >= 0 by repeated squaring
+static inline void vcomplexPow(vfloat& re, vfloat& im, int n)
+{
+    vfloat resultRe = vfloat(1.0f), resultIm = vfloat(0.0f);
+    while (n > 0) {
+        if (n & 1) {
+            vfloat t = resultRe * re - resultIm * im;
+            resultIm = resultRe * im + resultIm * re;
+            resultRe = t;
+        }
+        vfloat t = re * re - im * im;
+        im = vfloat(2.0f) * re * im;
+        re = t;
+        n >>= 1;
+    }
+    re = resultRe;
+    im = resultIm;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// distance estimator
+
+// FrameConstants::objectRotation, row major
+struct ObjectRotation {
+    float m[3][3];
+};
+
+static inline ObjectRotation toObjectRotation(const FrameConstants& frame)
+{
+    ObjectRotation rt;
+    for (int row = 0; row < 3; ++row)
+        for (int column = 0; column < 3; ++column)
+            rt.m[row][column] = frame.objectRotation[column][row];
+    return rt;
+}
+
+// packet version of mandelbulb(), lanes escape individually.
+// StaticPower > 0 is the triplex power known at compile time (the power loops unroll), 0 reads params at runtime
+template <int StaticPower>
+static inline vfloat mandelbulbDE(vfloat px, vfloat py, vfloat pz, const ObjectRotation& rt, const FractalParams& params, bool triplex)
+{
+    vfloat zx = fmadd(vfloat(rt.m[0][0]), px, fmadd(vfloat(rt.m[0][1]), py, vfloat(rt.m[0][2]) * pz));
+    vfloat zy = fmadd(vfloat(rt.m[1][0]), px, fmadd(vfloat(rt.m[1][1]), py, vfloat(rt.m[1][2]) * pz));
+    vfloat zz = fmadd(vfloat(rt.m[2][0]), px, fmadd(vfloat(rt.m[2][1]), py, vfloat(rt.m[2][2]) * pz));
+
+    vfloat derivative = vfloat(1.0f);
+    vfloat radius = vfloat(0.0f);
+    const int iterations = params.iterations;
+    const float power = StaticPower > 0 ? (float)StaticPower : params.power;
+
+    vmask active = firstLanes(cMaxPacketWidth);
+    for (int i = 0; i < iterations; i++) {
+        vfloat r = vsqrt(zx * zx + zy * zy + zz * zz);
+        radius = select(active, r, radius);
+        active = andnot(active, r > vfloat(2.0f));
+        if (!any(active)) break;
+
+        if (triplex) {
+            // see triplexPow in fractal/mandelbulb.h
+            const int n = StaticPower > 0 ? StaticPower : (int)power;
+            vfloat rho = vsqrt(zx * zx + zy * zy);
+            vfloat polarRe = zz / r, polarIm = rho / r;
+            vcomplexPow(polarRe, polarIm, n);
+            vfloat azimuthRe = zx / rho, azimuthIm = zy / rho;
+            vcomplexPow(azimuthRe, azimuthIm, n);
+            vmask onAxis = !(rho > vfloat(0.0f));
+            azimuthRe = select(onAxis, vfloat(1.0f), azimuthRe);
+            azimuthIm = select(onAxis, vfloat(0.0f), azimuthIm);
+
+            derivative = select(active, vipow(r, n - 1) * vfloat(power) * derivative + vfloat(1.0f), derivative);
+            vfloat zr = vipow(r, n);
+            zx = select(active, polarIm * azimuthRe * zr + px, zx);
+            zy = select(active, polarIm * azimuthIm * zr + py, zy);
+            zz = select(active, polarRe * zr + pz, zz);
+            continue;
+        }
+
+        // convert to spherical coordinates
+        vfloat theta = vacos(zz / r);
+        vfloat phi = vatan2(zy, zx);
+        vfloat rPowM1 = vpow(r, power - 1.0f);
+        derivative = select(active, rPowM1 * vfloat(power) * derivative + vfloat(1.0f), derivative);
+
+        // scale and rotate the point
+        vfloat zr = rPowM1 * r;
+        vfloat sinTheta, cosTheta, sinPhi, cosPhi;
+        vsincos(theta * vfloat(power), sinTheta, cosTheta);
+        vsincos(phi * vfloat(power), sinPhi, cosPhi);
+
+        // convert back to cartesian coordinates
+        zx = select(active, sinTheta * cosPhi * zr + px, zx);
+        zy = select(active, sinPhi * sinTheta * zr + py, zy);
+        zz = select(active, cosTheta * zr + pz, zz);
+    }
+    return vfloat(0.5f) * vlog(radius) * radius / derivative;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// analytic normals, packet version of Dual3 / mandelbulbGradient() in fractal/mandelbulb.h
+
+struct VDual {
+    vfloat v, dx, dy, dz;
+};
+
+static inline VDual dualConstant(vfloat v) { return { v, vfloat(0.0f), vfloat(0.0f), vfloat(0.0f) }; }
+static inline VDual operator+(VDual a, VDual b) { return { a.v + b.v, a.dx + b.dx, a.dy + b.dy, a.dz + b.dz }; }
+static inline VDual operator-(VDual a, VDual b) { return { a.v - b.v, a.dx - b.dx, a.dy - b.dy, a.dz - b.dz }; }
+static inline VDual operator*(VDual a, VDual b) { return { a.v * b.v, fmadd(a.dx, b.v, b.dx * a.v), fmadd(a.dy, b.v, b.dy * a.v), fmadd(a.dz, b.v, b.dz * a.v) }; }
+static inline VDual operator+(VDual a, vfloat s) { return { a.v + s, a.dx, a.dy, a.dz }; }
+static inline VDual operator*(VDual a, vfloat s) { return { a.v * s, a.dx * s, a.dy * s, a.dz * s }; }
+static inline VDual operator/(VDual a, VDual b)
+{
+    vfloat inv = vfloat(1.0f) / b.v;
+    vfloat q = a.v * inv;
+    return { q, (a.dx - b.dx * q) * inv, (a.dy - b.dy * q) * inv, (a.dz - b.dz * q) * inv };
+}
+static inline VDual select(vmask m, VDual a, VDual b) { return { select(m, a.v, b.v), select(m, a.dx, b.dx), select(m, a.dy, b.dy), select(m, a.dz, b.dz) }; }
+
+// f(a) where f(a.v) = value and f'(a.v) = slope
+static inline VDual dualChain(VDual a, vfloat value, vfloat slope) { return { value, a.dx * slope, a.dy * slope, a.dz * slope }; }
+static inline VDual dualSqrt(VDual a) { vfloat s = vsqrt(a.v); return dualChain(a, s, vfloat(0.5f) / s); }
+static inline VDual dualLog(VDual a) { return dualChain(a, vlog(a.v), vfloat(1.0f) / a.v); }
+static inline VDual dualAcos(VDual a) { return dualChain(a, vacos(a.v), vfloat(-1.0f) / vsqrt(vmax(vfloat(1.0f) - a.v * a.v, vfloat(1e-12f)))); }
+static inline VDual dualAtan2(VDual y, VDual x)
+{
+    vfloat inv = vfloat(1.0f) / (x.v * x.v + y.v * y.v);
+    return { vatan2(y.v, x.v), (y.dx * x.v - x.dx * y.v) * inv, (y.dy * x.v - x.dy * y.v) * inv, (y.dz * x.v - x.dz * y.v) * inv };
+}
+static inline VDual dualPow(VDual a, float p) { vfloat powM1 = vpow(a.v, p - 1.0f); return dualChain(a, powM1 * a.v, vfloat(p) * powM1); }
+static inline void dualSinCos(VDual a, VDual& s, VDual& c)
+{
+    vfloat sv, cv;
+    vsincos(a.v, sv, cv);
+    s = dualChain(a, sv, cv);
+    c = dualChain(a, cv, -sv);
+}
+
+static inline VDual dualIpow(VDual x, int n)
+{
+    VDual result = dualConstant(vfloat(1.0f));
+    while (n > 0) {
+        if (n & 1) result = result * x;
+        x = x * x;
+        n >>= 1;
+    }
+    return result;
+}
+
+static inline void dualComplexPow(VDual& re, VDual& im, int n)
+{
+    VDual resultRe = dualConstant(vfloat(1.0f)), resultIm = dualConstant(vfloat(0.0f));
+    while (n > 0) {
+        if (n & 1) {
+            VDual t = resultRe * re - resultIm * im;
+            resultIm = resultRe * im + resultIm * re;
+            resultRe = t;
+        }
+        VDual t = re * re - im * im;
+        im = re * im * vfloat(2.0f);
+        re = t;
+        n >>= 1;
+    }
+    re = resultRe;
+    im = resultIm;
+}
+
+template <int StaticPower>
+static inline void mandelbulbGradient(vfloat px, vfloat py, vfloat pz, const ObjectRotation& rt, const FractalParams& params, bool triplex,
+    vfloat& gx, vfloat& gy, vfloat& gz)
+{
+    VDual zx = { fmadd(vfloat(rt.m[0][0]), px, fmadd(vfloat(rt.m[0][1]), py, vfloat(rt.m[0][2]) * pz)), vfloat(rt.m[0][0]), vfloat(rt.m[0][1]), vfloat(rt.m[0][2]) };
+    VDual zy = { fmadd(vfloat(rt.m[1][0]), px, fmadd(vfloat(rt.m[1][1]), py, vfloat(rt.m[1][2]) * pz)), vfloat(rt.m[1][0]), vfloat(rt.m[1][1]), vfloat(rt.m[1][2]) };
+    VDual zz = { fmadd(vfloat(rt.m[2][0]), px, fmadd(vfloat(rt.m[2][1]), py, vfloat(rt.m[2][2]) * pz)), vfloat(rt.m[2][0]), vfloat(rt.m[2][1]), vfloat(rt.m[2][2]) };
+    const vfloat zero = vfloat(0.0f), one = vfloat(1.0f);
+    const VDual cx = { px, one, zero, zero }, cy = { py, zero, one, zero }, cz = { pz, zero, zero, one };
+
+    VDual derivative = dualConstant(one);
+    VDual radius = dualConstant(zero);
+    const int iterations = params.iterations;
+    const float power = StaticPower > 0 ? (float)StaticPower : params.power;
+
+    vmask active = firstLanes(cMaxPacketWidth);
+    for (int i = 0; i < iterations; i++) {
+        VDual r = dualSqrt(zx * zx + zy * zy + zz * zz);
+        radius = select(active, r, radius);
+        active = andnot(active, r.v > vfloat(2.0f));
+        if (!any(active)) break;
+
+        VDual nextX, nextY, nextZ, nextDerivative;
+        if (triplex) {
+            const int n = StaticPower > 0 ? StaticPower : (int)power;
+            VDual rPowM1 = dualIpow(r, n - 1);
+            nextDerivative = rPowM1 * vfloat(power) * derivative + one;
+
+            VDual rho = dualSqrt(zx * zx + zy * zy);
+            VDual polarRe = zz / r, polarIm = rho / r;
+            dualComplexPow(polarRe, polarIm, n);
+            VDual azimuthRe = zx / rho, azimuthIm = zy / rho;
+            dualComplexPow(azimuthRe, azimuthIm, n);
+            vmask onAxis = !(rho.v > zero);
+            azimuthRe = select(onAxis, dualConstant(one), azimuthRe);
+            azimuthIm = select(onAxis, dualConstant(zero), azimuthIm);
+
+            VDual zr = rPowM1 * r;
+            nextX = polarIm * azimuthRe * zr + cx;
+            nextY = polarIm * azimuthIm * zr + cy;
+            nextZ = polarRe * zr + cz;
+        } else {
+            VDual theta = dualAcos(zz / r) * vfloat(power);
+            VDual phi = dualAtan2(zy, zx) * vfloat(power);
+            nextDerivative = dualPow(r, power - 1.0f) * vfloat(power) * derivative + one;
+
+            VDual zr = dualPow(r, power);
+            VDual sinTheta, cosTheta, sinPhi, cosPhi;
+            dualSinCos(theta, sinTheta, cosTheta);
+            dualSinCos(phi, sinPhi, cosPhi);
+            nextX = sinTheta * cosPhi * zr + cx;
+            nextY = sinPhi * sinTheta * zr + cy;
+            nextZ = cosTheta * zr + cz;
+        }
+        derivative = select(active, nextDerivative, derivative);
+        zx = select(active, nextX, zx);
+        zy = select(active, nextY, zy);
+        zz = select(active, nextZ, zz);
+    }
+    VDual distance = dualLog(radius) * radius / derivative; // without the factor 0.5, only the direction is used
+    gx = distance.dx;
+    gy = distance.dy;
+    gz = distance.dz;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// marcher
+
+template <int StaticPower>
+static void marchPacket(const RayPacket& packet, const FrameConstants& frame, PacketResult& result)
+{
+    const FractalParams& params = frame.fractal;
+    const bool triplex = StaticPower > 0 || (params.formula == FormulaMode::Triplex && params.power == std::floor(params.power));
+
+    ObjectRotation rt = toObjectRotation(frame);
+
+    vfloat ox = vfloat(packet.originX), oy = vfloat(packet.originY), oz = vfloat(packet.originZ);
+    vfloat dx = vload(packet.dirX), dy = vload(packet.dirY), dz = vload(packet.dirZ);
+
+    const int max_ray_steps = params.maxRaySteps;
+    // hitThreshold(): proportional to the distance travelled with a pixel footprint, fixed otherwise
+    const bool footprint = frame.footprintSlope > 0.0f;
+    const vfloat slope = vfloat(frame.footprintSlope), min_distance = vfloat(params.minDistance);
+
+    vfloat total_dist = vfloat(0.0f);
+    vfloat max_dist = vfloat(FLT_MAX);
+    vfloat steps = vfloat(0.0f);
+    vfloat evaluations = vfloat(0.0f);
+    vfloat hitX = ox, hitY = oy, hitZ = oz; // rays that never hit keep a defined position, like shadePixel
+    vfloat hitDistance = vfloat(0.0f);
+    vmask active = firstLanes(packet.count);
+
+    // over-relaxation like march(): omega drops to 1 per lane once its unbounding spheres stop overlapping
+    const bool relaxed = params.overRelaxation > 1.0f;
+    vfloat omega = vfloat(params.overRelaxation);
+    vfloat previous = vfloat(0.0f), stepLength = vfloat(0.0f);
+
+    // bounding sphere clipping like march(): lanes that miss it are finished before the first estimate
+    if (frame.boundingRadius > 0.0f) {
+        float originDistance2 = packet.originX * packet.originX + packet.originY * packet.originY + packet.originZ * packet.originZ;
+        vfloat b = ox * dx + oy * dy + oz * dz;
+        vfloat discriminant = b * b - vfloat(originDistance2 - frame.boundingRadius * frame.boundingRadius);
+        vfloat root = vsqrt(vmax(discriminant, vfloat(0.0f)));
+        vfloat tFar = root - b;
+        vmask missed = (discriminant < vfloat(0.0f)) | (tFar < vfloat(0.0f));
+        total_dist = vmax(vfloat(0.0f) - b - root, vfloat(0.0f));
+        max_dist = tFar;
+        steps = select(missed, vfloat((float)max_ray_steps), steps);
+        active = andnot(active, missed);
+    }
+    total_dist = vmax(total_dist, vload(packet.start));
+
+    for (int step = 0; step < max_ray_steps && any(active); ++step) {
+        vfloat px = ox + dx * total_dist;
+        vfloat py = oy + dy * total_dist;
+        vfloat pz = oz + dz * total_dist;
+        vfloat distance = mandelbulbDE<StaticPower>(px, py, pz, rt, params, triplex);
+        evaluations = select(active, evaluations + vfloat(1.0f), evaluations);
+
+        // lanes whose relaxed step may have skipped the surface go back to the end of the previous sphere
+        vmask probing = active;
+        if (relaxed) {
+            vmask failed = active & (omega > vfloat(1.0f)) & (distance + previous < stepLength);
+            total_dist = select(failed, total_dist - (stepLength - previous), total_dist);
+            omega = select(failed, vfloat(1.0f), omega);
+            steps = select(failed, steps + vfloat(1.0f), steps);
+            probing = andnot(active, failed);
+        }
+
+        vmask hit = probing & (distance < (footprint ? total_dist * slope : min_distance));
+        hitX = select(hit, px, hitX);
+        hitY = select(hit, py, hitY);
+        hitZ = select(hit, pz, hitZ);
+        hitDistance = select(hit, total_dist, hitDistance);
+
+        vmask marching = andnot(probing, hit);
+        steps = select(marching, steps + vfloat(1.0f), steps);
+
+        // outside the escape radius the estimate is at least 0.69 and a ray moving outwards never comes back,
+        // neither does one that left the bounding sphere: finish it now with the result march() reaches after max_ray_steps
+        vmask escaped = marching & (px * px + py * py + pz * pz > vfloat(4.0f)) & (px * dx + py * dy + pz * dz > vfloat(0.0f));
+        escaped = escaped | (marching & (total_dist + distance > max_dist));
+        steps = select(escaped, vfloat((float)max_ray_steps), steps);
+        active = andnot(active, hit | escaped);
+
+        previous = select(marching, distance, previous);
+        stepLength = select(marching, relaxed ? distance * omega : distance, stepLength);
+        total_dist = select(marching, total_dist + stepLength, total_dist);
+    }
+
+    vstore(result.c, vfloat(1.0f) - steps / vfloat((float)max_ray_steps));
+    vstore(result.hitDistance, hitDistance);
+    vstore(result.evaluations, evaluations);
+
+    if (frame.normalSurface && params.normalMode == NormalMode::Analytic) {
+        vfloat nx, ny, nz;
+        mandelbulbGradient<StaticPower>(hitX, hitY, hitZ, rt, params, triplex, nx, ny, nz);
+        vfloat invLength = vfloat(1.0f) / vsqrt(nx * nx + ny * ny + nz * nz);
+        vstore(result.normalX, nx * invLength);
+        vstore(result.normalY, ny * invLength);
+        vstore(result.normalZ, nz * invLength);
+    } else if (frame.normalSurface) {
+        const float epsilon = 0.0005f;
+        vfloat e = vfloat(epsilon);
+        vfloat nx = mandelbulbDE<StaticPower>(hitX + e, hitY, hitZ, rt, params, triplex) - mandelbulbDE<StaticPower>(hitX - e, hitY, hitZ, rt, params, triplex);
+        vfloat ny = mandelbulbDE<StaticPower>(hitX, hitY + e, hitZ, rt, params, triplex) - mandelbulbDE<StaticPower>(hitX, hitY - e, hitZ, rt, params, triplex);
+        vfloat nz = mandelbulbDE<StaticPower>(hitX, hitY, hitZ + e, rt, params, triplex) - mandelbulbDE<StaticPower>(hitX, hitY, hitZ - e, rt, params, triplex);
+        vfloat invLength = vfloat(1.0f) / vsqrt(nx * nx + ny * ny + nz * nz);
+        vstore(result.normalX, nx * invLength);
+        vstore(result.normalY, ny * invLength);
+        vstore(result.normalZ, nz * invLength);
+    }
+}
+
+template <int StaticPower>
+static void coneMarchPacket(const ConePacket& cones, const FrameConstants& frame, float* start)
+{
+    const FractalParams& params = frame.fractal;
+    const bool triplex = StaticPower > 0 || (params.formula == FormulaMode::Triplex && params.power == std::floor(params.power));
+    ObjectRotation rt = toObjectRotation(frame);
+
+    const RayPacket& axes = cones.axes;
+    vfloat ox = vfloat(axes.originX), oy = vfloat(axes.originY), oz = vfloat(axes.originZ);
+    vfloat dx = vload(axes.dirX), dy = vload(axes.dirY), dz = vload(axes.dirZ);
+    vfloat tanHalfAngle = vload(cones.tanHalfAngle);
+
+    vfloat t = vfloat(0.0f);
+    vfloat max_dist = vfloat(FLT_MAX);
+    if (frame.boundingRadius > 0.0f) {
+        float originDistance2 = axes.originX * axes.originX + axes.originY * axes.originY + axes.originZ * axes.originZ;
+        vfloat b = ox * dx + oy * dy + oz * dz;
+        vfloat discriminant = b * b - vfloat(originDistance2 - frame.boundingRadius * frame.boundingRadius);
+        vfloat tFar = vsqrt(vmax(discriminant, vfloat(0.0f))) - b;
+        max_dist = select((discriminant < vfloat(0.0f)) | (tFar < vfloat(0.0f)), max_dist, tFar);
+    }
+
+    vmask active = firstLanes(axes.count);
+    for (int step = 0; step < params.maxRaySteps; ++step) {
+        active = active & (t < max_dist);
+        if (!any(active)) break;
+
+        vfloat distance = mandelbulbDE<StaticPower>(ox + dx * t, oy + dy * t, oz + dz * t, rt, params, triplex);
+        vfloat advance = (distance - t * tanHalfAngle) / (vfloat(1.0f) + tanHalfAngle);
+        vmask touching = advance < (frame.footprintSlope > 0.0f ? t * vfloat(frame.footprintSlope) : vfloat(params.minDistance));
+        active = andnot(active, touching);
+        t = select(active, t + advance, t);
+    }
+
+    alignas(64) float result[cMaxPacketWidth];
+    vstore(result, t);
+    for (int lane = 0; lane < axes.count; ++lane) start[lane] = result[lane];
+}
+
+// calls f with std::integral_constant<int, power> for the same specialized powers as dispatchDistanceEstimator,
+// with power 0 (read at runtime) otherwise. The iteration count stays a runtime loop here
+// because the lanes leave it individually anyway
+template <typename F>
+static void dispatchStaticPower(const FractalParams& params, F&& f)
+{
+    bool integerPower = params.formula == FormulaMode::Triplex && params.power == std::floor(params.power);
+    switch (integerPower ? (int)params.power : 0) {
+    case 3: f(std::integral_constant<int, 3>{}); break;
+    case 4: f(std::integral_constant<int, 4>{}); break;
+    case 8: f(std::integral_constant<int, 8>{}); break;
+    case 12: f(std::integral_constant<int, 12>{}); break;
+    default: f(std::integral_constant<int, 0>{}); break;
+    }
+}
+
+void marchPacket(const RayPacket& packet, const FrameConstants& frame, PacketResult& result)
+{
+    dispatchStaticPower(frame.fractal, [&](auto power) { marchPacket<decltype(power)::value>(packet, frame, result); });
+}
+
+void coneMarchPacket(const ConePacket& cones, const FrameConstants& frame, float* start)
+{
+    dispatchStaticPower(frame.fractal, [&](auto power) { coneMarchPacket<decltype(power)::value>(cones, frame, start); });
+}
@@ -0,0 +1,100 @@
+#include "cpu/packet_marcher.h"
+#include <cfloat>
+#include <cmath>
+#include <type_traits>
+#include <immintrin.h>
+
+// Everything below is compiled for AVX2 + FMA without changing the flags of the whole target,
+// the renderer only calls into this file if isSimdIsaSupported(SimdIsa::Avx2).
+// Standard headers are included above so their inline functions are not compiled for AVX2.
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+namespace avx2 {
+
+struct vfloat {
+    __m256 v;
+    vfloat() = default;
+    vfloat(__m256 v) : v{ v } {}
+    explicit vfloat(float f) : v{ _mm256_set1_ps(f) } {}
+};
+
+struct vint {
+    __m256i v;
+    vint() = default;
+    vint(__m256i v) : v{ v } {}
+    explicit vint(int i) : v{ _mm256_set1_epi32(i) } {}
+};
+
+struct vmask {
+    __m256 m;
+};
+
+static inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+static inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+static inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+static inline vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v, b.v); }
+static inline vfloat operator-(vfloat a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+
+static inline vmask operator<(vfloat a, vfloat b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+static inline vmask operator>(vfloat a, vfloat b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+static inline vmask operator==(vfloat a, vfloat b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+
+static inline vmask operator&(vmask a, vmask b) { return { _mm256_and_ps(a.m, b.m) }; }
+static inline vmask operator|(vmask a, vmask b) { return { _mm256_or_ps(a.m, b.m) }; }
+static inline vmask operator!(vmask a) { return { _mm256_xor_ps(a.m, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+// a & !b
+static inline vmask andnot(vmask a, vmask b) { return { _mm256_andnot_ps(b.m, a.m) }; }
+static inline bool any(vmask a) { return _mm256_movemask_ps(a.m) != 0; }
+static inline vfloat select(vmask m, vfloat a, vfloat b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+
+static inline vint operator+(vint a, vint b) { return _mm256_add_epi32(a.v, b.v); }
+static inline vint operator-(vint a, vint b) { return _mm256_sub_epi32(a.v, b.v); }
+static inline vint operator&(vint a, vint b) { return _mm256_and_si256(a.v, b.v); }
+static inline vmask nonzero(vint a) { return { _mm256_castsi256_ps(_mm256_xor_si256(_mm256_cmpeq_epi32(a.v, _mm256_setzero_si256()), _mm256_set1_epi32(-1))) }; }
+
+static inline vfloat fmadd(vfloat a, vfloat b, vfloat c) { return _mm256_fmadd_ps(a.v, b.v, c.v); }
+static inline vfloat vsqrt(vfloat a) { return _mm256_sqrt_ps(a.v); }
+static inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a.v, b.v); }
+static inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a.v, b.v); }
+static inline vfloat vabs(vfloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+static inline vfloat vfloor(vfloat a) { return _mm256_round_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+static inline vint toInt(vfloat a) { return _mm256_cvttps_epi32(a.v); }
+static inline vfloat toFloat(vint a) { return _mm256_cvtepi32_ps(a.v); }
+static inline vfloat vload(const float* p) { return _mm256_load_ps(p); }
+static inline void vstore(float* p, vfloat a) { _mm256_store_ps(p, a.v); }
+
+// x = m * 2^e with m in [0.5, 1), x > 0 and normal
+static inline vfloat vfrexp(vfloat x, vfloat& e)
+{
+    __m256i bits = _mm256_castps_si256(x.v);
+    e = toFloat(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+    bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f000000));
+    return _mm256_castsi256_ps(bits);
+}
+
+// 2^n for n in [-126, 127]
+static inline vfloat vpow2i(vint n)
+{
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n.v, _mm256_set1_epi32(127)), 23));
+}
+
+static inline vmask firstLanes(int count)
+{
+    __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    return { _mm256_cmp_ps(lane, _mm256_set1_ps((float)count), _CMP_LT_OQ) };
+}
+
+#include "cpu/packet_marcher.inl"
+
+} // namespace avx2
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
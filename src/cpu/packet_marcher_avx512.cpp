@@ -0,0 +1,97 @@
+#include "cpu/packet_marcher.h"
+#include <cfloat>
+#include <cmath>
+#include <type_traits>
+#include <immintrin.h>
+
+// Everything below is compiled for AVX-512F without changing the flags of the whole target,
+// the renderer only calls into this file if isSimdIsaSupported(SimdIsa::Avx512).
+// Standard headers are included above so their inline functions are not compiled for AVX-512.
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+
+namespace avx512 {
+
+struct vfloat {
+    __m512 v;
+    vfloat() = default;
+    vfloat(__m512 v) : v{ v } {}
+    explicit vfloat(float f) : v{ _mm512_set1_ps(f) } {}
+};
+
+struct vint {
+    __m512i v;
+    vint() = default;
+    vint(__m512i v) : v{ v } {}
+    explicit vint(int i) : v{ _mm512_set1_epi32(i) } {}
+};
+
+struct vmask {
+    __mmask16 m;
+};
+
+static inline vfloat operator+(vfloat a, vfloat b) { return _mm512_add_ps(a.v, b.v); }
+static inline vfloat operator-(vfloat a, vfloat b) { return _mm512_sub_ps(a.v, b.v); }
+static inline vfloat operator*(vfloat a, vfloat b) { return _mm512_mul_ps(a.v, b.v); }
+static inline vfloat operator/(vfloat a, vfloat b) { return _mm512_div_ps(a.v, b.v); }
+static inline vfloat operator-(vfloat a) { return _mm512_castsi512_ps(_mm512_xor_epi32(_mm512_castps_si512(a.v), _mm512_set1_epi32((int)0x80000000))); }
+
+static inline vmask operator<(vfloat a, vfloat b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+static inline vmask operator>(vfloat a, vfloat b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+static inline vmask operator==(vfloat a, vfloat b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ) }; }
+
+static inline vmask operator&(vmask a, vmask b) { return { (__mmask16)(a.m & b.m) }; }
+static inline vmask operator|(vmask a, vmask b) { return { (__mmask16)(a.m | b.m) }; }
+static inline vmask operator!(vmask a) { return { (__mmask16)~a.m }; }
+// a & !b
+static inline vmask andnot(vmask a, vmask b) { return { (__mmask16)(a.m & ~b.m) }; }
+static inline bool any(vmask a) { return a.m != 0; }
+static inline vfloat select(vmask m, vfloat a, vfloat b) { return _mm512_mask_blend_ps(m.m, b.v, a.v); }
+
+static inline vint operator+(vint a, vint b) { return _mm512_add_epi32(a.v, b.v); }
+static inline vint operator-(vint a, vint b) { return _mm512_sub_epi32(a.v, b.v); }
+static inline vint operator&(vint a, vint b) { return _mm512_and_epi32(a.v, b.v); }
+static inline vmask nonzero(vint a) { return { _mm512_test_epi32_mask(a.v, a.v) }; }
+
+static inline vfloat fmadd(vfloat a, vfloat b, vfloat c) { return _mm512_fmadd_ps(a.v, b.v, c.v); }
+static inline vfloat vsqrt(vfloat a) { return _mm512_sqrt_ps(a.v); }
+static inline vfloat vmin(vfloat a, vfloat b) { return _mm512_min_ps(a.v, b.v); }
+static inline vfloat vmax(vfloat a, vfloat b) { return _mm512_max_ps(a.v, b.v); }
+static inline vfloat vabs(vfloat a) { return _mm512_abs_ps(a.v); }
+static inline vfloat vfloor(vfloat a) { return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+static inline vint toInt(vfloat a) { return _mm512_cvttps_epi32(a.v); }
+static inline vfloat toFloat(vint a) { return _mm512_cvtepi32_ps(a.v); }
+static inline vfloat vload(const float* p) { return _mm512_load_ps(p); }
+static inline void vstore(float* p, vfloat a) { _mm512_store_ps(p, a.v); }
+
+// x = m * 2^e with m in [0.5, 1), x > 0 and normal
+static inline vfloat vfrexp(vfloat x, vfloat& e)
+{
+    e = _mm512_add_ps(_mm512_getexp_ps(x.v), _mm512_set1_ps(1.0f));
+    return _mm512_getmant_ps(x.v, _MM_MANT_NORM_p5_1, _MM_MANT_SIGN_src);
+}
+
+// 2^n for n in [-126, 127]
+static inline vfloat vpow2i(vint n)
+{
+    return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(n.v, _mm512_set1_epi32(127)), 23));
+}
+
+static inline vmask firstLanes(int count)
+{
+    return { (__mmask16)(count >= 16 ? 0xffff : (1u << count) - 1u) };
+}
+
+#include "cpu/packet_marcher.inl"
+
+} // namespace avx512
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
@@ -2,6 +2,9 @@
 #include <cuda_runtime.h>
 #include <device_launch_parameters.h>
 #include "interop.cuh"
+#include "fractal/mandelbulb.h"
+#include "fractal/deep_zoom.h"
+#include "fractal/edge_antialiasing.h"
 #include "stdio.h"
 #include <memory>
 #include <cuda/std/complex>
@@ -20,12 +23,71 @@ float _zoom = 1.0f;
 cudaExternalMemory_t cudaExtMemImageBuffer; // memory handler to the imported memory allocation
 cudaMipmappedArray_t cudaMipmappedImageArray; // the image interpreted as a mipmapped array
 cudaSurfaceObject_t surfaceObject; // surface object to the first mip level of the array. Allows write
+float* coneStartBuffer = nullptr; // start distance of every cone tile, written by ConePrepass
+float* hitDistanceBuffers[2] = {}; // per pixel hit distances of this and the previous frame for the reprojection
+glm::vec4* accumulationBuffer = nullptr; // mean of the samples of every pixel for the progressive refinement
+uint32_t historyIndex = 0; // hitDistanceBuffers[historyIndex] is written by the next renderCuda call
+ReferenceOrbit hostReferenceOrbit; // computed for the deep zoom path on the host, copied to referenceOrbitBuffer
+ReferenceOrbit* referenceOrbitBuffer = nullptr;
+BrickMapView deviceBrickMap = {}; // device copy of the brick map, resolution 0 if there is none
+PixelCounters* pixelCounterBuffer = nullptr; // counters of instrumented frames, allocated by the first one
+float* edgeContrastBuffer = nullptr; // edgeContrast of every pixel for the edge-adaptive supersampling
+unsigned int* edgeHistogramBuffer = nullptr; // cEdgeHistogramBins counts of the contrasts above the threshold
+int* edgeCutoffBuffer = nullptr; // edgeCutoffBin of the histogram, computed on the device so nothing waits for it
 
 void freeExportedVulkanImage()
 {
     checkCudaError(cudaDestroySurfaceObject(surfaceObject));
     checkCudaError(cudaFreeMipmappedArray(cudaMipmappedImageArray));
     checkCudaError(cudaDestroyExternalMemory(cudaExtMemImageBuffer));
+    checkCudaError(cudaFree(coneStartBuffer));
+    coneStartBuffer = nullptr;
+    for (auto& it : hitDistanceBuffers) {
+        checkCudaError(cudaFree(it));
+        it = nullptr;
+    }
+    checkCudaError(cudaFree(accumulationBuffer));
+    accumulationBuffer = nullptr;
+    checkCudaError(cudaFree(referenceOrbitBuffer));
+    referenceOrbitBuffer = nullptr;
+    checkCudaError(cudaFree(pixelCounterBuffer));
+    pixelCounterBuffer = nullptr;
+    checkCudaError(cudaFree(edgeContrastBuffer));
+    edgeContrastBuffer = nullptr;
+    checkCudaError(cudaFree(edgeHistogramBuffer));
+    edgeHistogramBuffer = nullptr;
+    checkCudaError(cudaFree(edgeCutoffBuffer));
+    edgeCutoffBuffer = nullptr;
+}
+
+void freeCudaBrickMap()
+{
+    checkCudaError(cudaFree((void*)deviceBrickMap.centreDistance));
+    checkCudaError(cudaFree((void*)deviceBrickMap.brickIndex));
+    checkCudaError(cudaFree((void*)deviceBrickMap.bricks));
+    deviceBrickMap = {};
+}
+
+void uploadCudaBrickMap(const BrickMapView& map, size_t brickCount)
+{
+    checkCudaError(cudaDeviceSynchronize()); // the kernels in flight may still read the old map
+    freeCudaBrickMap();
+    if (map.resolution == 0) return;
+
+    size_t cells = (size_t)map.resolution * map.resolution * map.resolution;
+    float* centreDistance;
+    int* brickIndex;
+    float* bricks;
+    checkCudaError(cudaMalloc(&centreDistance, cells * sizeof(float)));
+    checkCudaError(cudaMalloc(&brickIndex, cells * sizeof(int)));
+    checkCudaError(cudaMalloc(&bricks, brickCount * cBrickSampleCount * sizeof(float)));
+    checkCudaError(cudaMemcpy(centreDistance, map.centreDistance, cells * sizeof(float), cudaMemcpyHostToDevice));
+    checkCudaError(cudaMemcpy(brickIndex, map.brickIndex, cells * sizeof(int), cudaMemcpyHostToDevice));
+    checkCudaError(cudaMemcpy(bricks, map.bricks, brickCount * cBrickSampleCount * sizeof(float), cudaMemcpyHostToDevice));
+    deviceBrickMap = map;
+    deviceBrickMap.centreDistance = centreDistance;
+    deviceBrickMap.brickIndex = brickIndex;
+    deviceBrickMap.bricks = bricks;
 }
 
 void exportVulkanImageToCuda_R8G8B8A8Unorm(void* mem, VkDeviceSize size, VkDeviceSize offset, uint32_t width, uint32_t height)
@@ -73,14 +135,39 @@ void exportVulkanImageToCuda_R8G8B8A8Unorm(void* mem, VkDeviceSize size, VkDevic
     resourceDesc.res.array.array = cudaMipLevelArray;
     
     checkCudaError(cudaCreateSurfaceObject(&surfaceObject, &resourceDesc));
+
+    // sized for the whole image, smaller frames use the first tilesX * tilesY entries
+    uint32_t coneTilesX = (width + cConeTileSize - 1) / cConeTileSize;
+    uint32_t coneTilesY = (height + cConeTileSize - 1) / cConeTileSize;
+    checkCudaError(cudaMalloc(&coneStartBuffer, (size_t)coneTilesX * coneTilesY * sizeof(float)));
+    for (auto& it : hitDistanceBuffers) checkCudaError(cudaMalloc(&it, (size_t)width * height * sizeof(float)));
+    checkCudaError(cudaMalloc(&accumulationBuffer, (size_t)width * height * sizeof(glm::vec4)));
+    checkCudaError(cudaMalloc(&referenceOrbitBuffer, sizeof(ReferenceOrbit)));
+    checkCudaError(cudaMalloc(&edgeContrastBuffer, (size_t)width * height * sizeof(float)));
+    checkCudaError(cudaMalloc(&edgeHistogramBuffer, cEdgeHistogramBins * sizeof(unsigned int)));
+    checkCudaError(cudaMalloc(&edgeCutoffBuffer, sizeof(int)));
+}
+
+bool isCudaAvailable()
+{
+    int deviceCount = 0;
+    return cudaGetDeviceCount(&deviceCount) == cudaSuccess && deviceCount > 0;
 }
 
 cudaExternalSemaphore_t cudaWaitsForVulkanSemaphore, vulkanWaitsForCudaSemaphore;
+cudaEvent_t renderStartEvent, renderEndEvent; // around the kernels of renderCuda
+bool renderTimingPending = false; // renderEndEvent was recorded but not read yet
+CudaRenderTiming pendingTiming; // the frame between the events, without the time
+CudaRenderTiming finishedTiming; // the last one read from the events
+bool finishedTimingTaken = true; // by takeCudaRenderTiming
 
 void freeExportedSemaphores()
 {
     checkCudaError(cudaDestroyExternalSemaphore(cudaWaitsForVulkanSemaphore));
     checkCudaError(cudaDestroyExternalSemaphore(vulkanWaitsForCudaSemaphore));
+    checkCudaError(cudaEventDestroy(renderStartEvent));
+    checkCudaError(cudaEventDestroy(renderEndEvent));
+    renderTimingPending = false;
 }
 
 void exportSemaphoresToCuda(void* cudaWaitsForVulkanSemaphoreHandle, void* vulkanWaitsForCudaSemaphoreHandle) {
@@ -94,162 +181,249 @@ void exportSemaphoresToCuda(void* cudaWaitsForVulkanSemaphoreHandle, void* vulka
 
     externalSemaphoreHandleDesc.handle.win32.handle = vulkanWaitsForCudaSemaphoreHandle;
     checkCudaError(cudaImportExternalSemaphore(&vulkanWaitsForCudaSemaphore, &externalSemaphoreHandleDesc));
-}
 
-// compresses 4 32bit floats into a 32bit uint
-__device__ unsigned int rgbaFloatToInt(float4 rgba) {
-    rgba.x = __saturatef(rgba.x);  // clamp to [0.0, 1.0]
-    rgba.y = __saturatef(rgba.y);
-    rgba.z = __saturatef(rgba.z);
-    rgba.w = __saturatef(rgba.w);
-    return ((unsigned int)(rgba.w * 255.0f) << 24) |
-        ((unsigned int)(rgba.z * 255.0f) << 16) |
-        ((unsigned int)(rgba.y * 255.0f) << 8) |
-        ((unsigned int)(rgba.x * 255.0f));
+    checkCudaError(cudaEventCreate(&renderStartEvent));
+    checkCudaError(cudaEventCreate(&renderEndEvent));
 }
 
-__device__ float3 operator+(const float3& a, const float3& b) {
-    return make_float3(a.x + b.x, a.y + b.y, a.z + b.z);
-}
-
-__device__ float3 operator*(const float3& a, const float& b) {
-    return make_float3(a.x * b, a.y * b, a.z * b);
+void readCudaPixelCounters(PixelCounters* counters, size_t count)
+{
+    if (!pixelCounterBuffer) return;
+    checkCudaError(cudaMemcpy(counters, pixelCounterBuffer, count * sizeof(PixelCounters), cudaMemcpyDeviceToHost));
 }
 
-__device__ float length(const float3& vec) {
-    return sqrt(vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
+// never blocks, a frame still in flight is read by a later call
+static void pollRenderTiming()
+{
+    if (renderTimingPending && cudaEventQuery(renderEndEvent) == cudaSuccess) {
+        finishedTiming = pendingTiming;
+        checkCudaError(cudaEventElapsedTime(&finishedTiming.milliseconds, renderStartEvent, renderEndEvent));
+        renderTimingPending = false;
+        finishedTimingTaken = false;
+    }
 }
 
-__device__ float3 normalize(const float3 vec) {
-    float inverted_len = 1.0f / length(vec);
-    return vec * inverted_len;
+float getCudaRenderMilliseconds()
+{
+    pollRenderTiming();
+    return finishedTiming.milliseconds;
 }
 
-typedef struct {
-    float3 origin;
-    float3 direction;
-} ray;
-
-__device__ ray get_ray(const float& u, const float& v, float zoom, float offsetX, float offsetY) {
-    ray r;
-    r.origin = make_float3(-3.0, 0.05, 0.05);
-    r.direction = normalize(make_float3(1.0 * zoom, u + offsetX, v + offsetY));
-    return r;
+bool takeCudaRenderTiming(CudaRenderTiming* timing)
+{
+    pollRenderTiming();
+    if (finishedTimingTaken) return false;
+    *timing = finishedTiming;
+    finishedTimingTaken = true;
+    return true;
 }
 
-__device__ float mandelbulb(float3 pos, float3 rotation) {
-    float3 z = pos;
-
-    // Rotate around X axis
-    float temp_y = z.y;
-    z.y = z.y * cos(rotation.x) - z.z * sin(rotation.x);
-    z.z = temp_y * sin(rotation.x) + z.z * cos(rotation.x);
-
-    // Rotate around Y axis
-    float temp_x = z.x;
-    z.x = z.x * cos(rotation.y) - z.z * sin(rotation.y);
-    z.z = temp_x * sin(rotation.y) + z.z * cos(rotation.y);
+// one thread per cone tile
+template <typename DE>
+__global__ void ConePrepass(float* coneStart, uint32_t tilesX, uint32_t tilesY, FrameConstants frame, DE de)
+{
+    unsigned int x = blockIdx.x * blockDim.x + threadIdx.x;
+    unsigned int y = blockIdx.y * blockDim.y + threadIdx.y;
 
-    // Rotate around Z axis
-    temp_x = z.x;
-    z.x = z.x * cos(rotation.z) - z.y * sin(rotation.z);
-    z.y = temp_x * sin(rotation.z) + z.y * cos(rotation.z);
+    if (x >= tilesX || y >= tilesY) return;
 
-    float derivative = 1.0;
-    float radius = 0.0;
-    int iterations = 12;
-    float power = 12.0;
+    coneStart[y * tilesX + x] = coneMarch(x, y, frame, de);
+}
 
-    for (int i = 0; i < iterations; i++) {
+// one instantiation per distance estimator, see dispatchDistanceEstimator, and a second one with Instrumented set
+// that writes counters (see fractal/pixel_counters.h) so the normal kernel carries none of it.
+// frame is passed by value so it lives in the constant bank like every kernel parameter.
+// coneStart is the output of ConePrepass or nullptr, history the previous frame's hitDistance or nullptr.
+// The progressive passes below cRefinementSubsets run one thread per 2x2 block, see cRefinementSubsets
+template <typename DE, bool Instrumented>
+__global__ void MandelbulbDraw(cudaSurfaceObject_t dstSurface, FrameConstants frame, DE de, const float* coneStart, uint32_t coneTilesX,
+    const float* history, float* hitDistance, glm::vec4* accumulation, PixelCounters* counters)
+{
+    unsigned int x = blockIdx.x * blockDim.x + threadIdx.x;
+    unsigned int y = blockIdx.y * blockDim.y + threadIdx.y;
 
-        radius = length(z);
+    glm::vec2 jitter = glm::vec2(0.0f);
+    if (frame.progressive && frame.refinementPass < cRefinementSubsets) {
+        glm::uvec2 offset = refinementOffset(frame.refinementPass);
+        x = 2 * x + offset.x;
+        y = 2 * y + offset.y;
+    } else if (frame.progressive) {
+        jitter = refinementJitter(frame.refinementPass);
+    }
 
-        if (radius > 2.0) break;
+    if (x >= frame.width || y >= frame.height) return;
+
+    float start = coneStart ? coneStart[(y / cConeTileSize) * coneTilesX + x / cConeTileSize] : 0.0f;
+    float sampleHitDistance;
+    unsigned int pixel = y * frame.width + x;
+    glm::vec4 dataOut;
+    if constexpr (Instrumented) {
+        PixelCounters sampleCounters;
+        dataOut = shadeInstrumentedSample((float)x + jitter.x, (float)y + jitter.y, frame, de, &sampleCounters, start, history, &sampleHitDistance);
+        if (frame.heatmap) dataOut = heatmapColor(sampleCounters, frame, dataOut);
+        counters[pixel] = sampleCounters;
+    } else {
+        dataOut = shadeSample((float)x + jitter.x, (float)y + jitter.y, frame, de, start, history, &sampleHitDistance);
+    }
 
-        // convert to spherical coordinates
-        float theta = acos(z.z / radius);
-        float phi = atan2(z.y, z.x);
-        derivative = powf(radius, power - 1.0) * power * derivative + 1.0;
+    if (!frame.progressive) {
+        hitDistance[pixel] = sampleHitDistance;
+    } else if (frame.refinementPass >= cRefinementSubsets) {
+        dataOut = accumulation[pixel] = accumulateSample(accumulation[pixel], dataOut, frame.refinementPass);
+    } else if (frame.refinementPass > 0) {
+        accumulation[pixel] = dataOut;
+    } else {
+        // pass 0 fills the whole block with the sample of its top left pixel
+        for (unsigned int by = y; by < glm::min(y + 2, frame.height); ++by) {
+            for (unsigned int bx = x; bx < glm::min(x + 2, frame.width); ++bx) {
+                accumulation[by * frame.width + bx] = dataOut;
+                hitDistance[by * frame.width + bx] = sampleHitDistance;
+                surf2Dwrite(rgbaFloatToInt(dataOut), dstSurface, bx * 4, by);
+            }
+        }
+        return;
+    }
 
-        // scale and rotate the point
-        float zr = pow(radius, power);
-        theta = theta * power;
-        phi = phi * power;
+    surf2Dwrite(rgbaFloatToInt(dataOut), dstSurface, x * 4, y);
+}
 
-        // convert back to cartesian coordinates
-        z = make_float3(sin(theta) * cos(phi), sin(phi) * sin(theta), cos(theta)) * zr;
+// packed colours of the primary image for edgeContrast
+struct SurfaceTexels {
+    cudaSurfaceObject_t surface;
 
-        z = z + pos;
+    __device__ unsigned int operator()(unsigned int x, unsigned int y) const {
+        return surf2Dread<unsigned int>(surface, x * 4, y);
     }
-    return 0.5 * log(radius) * radius / derivative;
-}
+};
 
-__device__ float3 calculateNormal(float3 pos, float3 rotation) {
-    float epsilon = 0.0005;
-    float dx = mandelbulb(make_float3(pos.x + epsilon, pos.y, pos.z), rotation) - mandelbulb(make_float3(pos.x - epsilon, pos.y, pos.z), rotation);
-    float dy = mandelbulb(make_float3(pos.x, pos.y + epsilon, pos.z), rotation) - mandelbulb(make_float3(pos.x, pos.y - epsilon, pos.z), rotation);
-    float dz = mandelbulb(make_float3(pos.x, pos.y, pos.z + epsilon), rotation) - mandelbulb(make_float3(pos.x, pos.y, pos.z - epsilon), rotation);
-    return normalize(make_float3(dx, dy, dz));
-}
+// edge-adaptive supersampling, see fractal/edge_antialiasing.h. One thread per pixel, the histogram is counted per
+// block in shared memory first
+__global__ void EdgeContrast(cudaSurfaceObject_t surface, FrameConstants frame, const float* hitDistance, float* contrast, unsigned int* histogram)
+{
+    __shared__ unsigned int blockHistogram[cEdgeHistogramBins];
+    unsigned int thread = threadIdx.y * blockDim.x + threadIdx.x;
+    if (thread < cEdgeHistogramBins) blockHistogram[thread] = 0;
+    __syncthreads();
 
-__device__ float march(ray r, float3 rotation, float3* hitPos) {
-    float total_dist = 0.0;
-    int max_ray_steps = 50;
-    float min_distance = 0.0005;
-
-    int steps;
-    for (steps = 0; steps < max_ray_steps; ++steps) {
-        float3 p = r.origin + r.direction * total_dist;
-        float distance = mandelbulb(p, rotation);
-        total_dist += distance;
-        if (distance < min_distance) {
-            *hitPos = p;
-            break;
-        }
+    unsigned int x = blockIdx.x * blockDim.x + threadIdx.x;
+    unsigned int y = blockIdx.y * blockDim.y + threadIdx.y;
+    if (x < frame.width && y < frame.height) {
+        float pixelContrast = edgeContrast(x, y, frame, SurfaceTexels{ surface }, hitDistance);
+        contrast[y * frame.width + x] = pixelContrast;
+        if (pixelContrast > frame.edgeThreshold) atomicAdd(&blockHistogram[edgeHistogramBin(pixelContrast, frame)], 1u);
     }
-    return 1.0 - (float)steps / (float)max_ray_steps;
+    __syncthreads();
+    if (thread < cEdgeHistogramBins && blockHistogram[thread] > 0) atomicAdd(&histogram[thread], blockHistogram[thread]);
 }
 
+// single thread
+__global__ void EdgeCutoff(const unsigned int* histogram, FrameConstants frame, int* cutoffBin)
+{
+    *cutoffBin = edgeCutoffBin(histogram, frame);
+}
 
-__global__ void MandelbulbDraw(cudaSurfaceObject_t dstSurface, size_t width, size_t height, float zoom, float offsetX, float offsetY, float3 rotation, bool normal_surface)
+// one thread per pixel, the refined ones average their primary sample with frame.edgeSamples more
+template <typename DE>
+__global__ void EdgeRefine(cudaSurfaceObject_t surface, FrameConstants frame, DE de, const float* coneStart, uint32_t coneTilesX,
+    const float* contrast, const int* cutoffBin)
 {
     unsigned int x = blockIdx.x * blockDim.x + threadIdx.x;
     unsigned int y = blockIdx.y * blockDim.y + threadIdx.y;
 
-    if (x >= width || y >= height) return;
-
-    float min_w_h = (float)min(width, height);
+    if (x >= frame.width || y >= frame.height || !isRefinedEdge(contrast[y * frame.width + x], *cutoffBin, frame)) return;
 
-    float ar = (float)width / (float)height;
-    float u = (float)x / min_w_h - ar * 0.5f;
-    float v = (float)y / min_w_h - 0.5f;
-
-    ray r = get_ray(u, v, zoom, offsetX, offsetY);
-    float3 hitPos;
-    float c = march(r, rotation, &hitPos);
-
-    float4 dataOut = make_float4(c * 0.5f, c * 0.5f, c * 1.0f, 1.0f);
-
-    if (normal_surface) {
-        float3 normal = calculateNormal(hitPos, rotation) * 0.5f + make_float3(0.4f, 0.4f, 0.4f);
-        dataOut = make_float4(normal.x, normal.y, normal.z, 1.0f);
-	}
+    float start = coneStart ? coneStart[(y / cConeTileSize) * coneTilesX + x / cConeTileSize] : 0.0f;
+    glm::vec4 primary = rgbaIntToFloat(surf2Dread<unsigned int>(surface, x * 4, y));
+    surf2Dwrite(rgbaFloatToInt(antialiasEdge(x, y, frame, de, primary, start)), surface, x * 4, y);
+}
 
-    surf2Dwrite(rgbaFloatToInt(dataOut), dstSurface, x * 4, y);
+bool loadCudaKernelVariant(const FractalParams& params)
+{
+    // querying the attributes of a kernel loads its module (and compiles its PTX if needed) like the first launch would
+    bool ok = true;
+    dispatchDistanceEstimator(params, [&ok](auto de) {
+        using DE = decltype(de);
+        cudaFuncAttributes attributes;
+        ok = cudaFuncGetAttributes(&attributes, ConePrepass<DE>) == cudaSuccess
+            && cudaFuncGetAttributes(&attributes, MandelbulbDraw<DE, false>) == cudaSuccess
+            && cudaFuncGetAttributes(&attributes, MandelbulbDraw<DE, true>) == cudaSuccess
+            && cudaFuncGetAttributes(&attributes, EdgeRefine<DE>) == cudaSuccess;
+    });
+    return ok;
 }
 
-void renderCuda(float zoom, float offsetX, float offsetY, float t1, float t2, float t3, bool normal_surface)
+void renderCuda(const FrameConstants& frame)
 {
     cudaExternalSemaphoreWaitParams extSemaphoreWaitParams;
     memset(&extSemaphoreWaitParams, 0, sizeof(extSemaphoreWaitParams));
     extSemaphoreWaitParams.params.fence.value = 0;
     extSemaphoreWaitParams.flags = 0; checkCudaError(cudaWaitExternalSemaphoresAsync(&cudaWaitsForVulkanSemaphore, &extSemaphoreWaitParams, 1));
 
+    pollRenderTiming(); // keep the timing of the previous frame before its events are recorded again
+    bool timed = !renderTimingPending;
+    if (timed) checkCudaError(cudaEventRecord(renderStartEvent));
+
+    // threads per row and column, one per 2x2 block in the first progressive passes
+    bool fullFrame = !frame.progressive || frame.refinementPass >= cRefinementSubsets;
+    uint32_t threadsX = frame.width, threadsY = frame.height;
+    if (!fullFrame) {
+        threadsX = (threadsX + 1) / 2;
+        threadsY = (threadsY + 1) / 2;
+    }
     uint32_t nthreads = 32;
-    dim3 dimGrid{ imageWidth / nthreads + 1, imageHeight / nthreads + 1};
+    dim3 dimGrid{ threadsX / nthreads + 1, threadsY / nthreads + 1};
     dim3 dimBlock{ nthreads, nthreads };
-    float3 rotation = make_float3(t1, t2, t3);
-    MandelbulbDraw << <dimGrid, dimBlock >> > (surfaceObject, imageWidth, imageHeight, zoom, offsetX, offsetY, rotation, normal_surface);
+    uint32_t tilesX = (frame.width + cConeTileSize - 1) / cConeTileSize;
+    uint32_t tilesY = (frame.height + cConeTileSize - 1) / cConeTileSize;
+    auto render = [&](auto de) {
+        const float* coneStart = nullptr;
+        if (frame.conePrepass) {
+            uint32_t coneThreads = 16;
+            dim3 coneGrid{ (tilesX + coneThreads - 1) / coneThreads, (tilesY + coneThreads - 1) / coneThreads };
+            ConePrepass << <coneGrid, dim3{ coneThreads, coneThreads } >> > (coneStartBuffer, tilesX, tilesY, frame, de);
+            checkCudaError(cudaGetLastError());
+            coneStart = coneStartBuffer;
+        }
+        const float* history = frame.reprojection ? hitDistanceBuffers[historyIndex ^ 1] : nullptr;
+        if (frame.instrumentation) {
+            MandelbulbDraw<decltype(de), true> << <dimGrid, dimBlock >> > (surfaceObject, frame, de, coneStart, tilesX, history, hitDistanceBuffers[historyIndex],
+                accumulationBuffer, pixelCounterBuffer);
+        } else {
+            MandelbulbDraw<decltype(de), false> << <dimGrid, dimBlock >> > (surfaceObject, frame, de, coneStart, tilesX, history, hitDistanceBuffers[historyIndex],
+                accumulationBuffer, nullptr);
+        }
+        if (frame.edgeSamples > 0 && !frame.progressive) {
+            checkCudaError(cudaMemsetAsync(edgeHistogramBuffer, 0, cEdgeHistogramBins * sizeof(unsigned int)));
+            EdgeContrast << <dimGrid, dimBlock >> > (surfaceObject, frame, hitDistanceBuffers[historyIndex], edgeContrastBuffer, edgeHistogramBuffer);
+            EdgeCutoff << <1, 1 >> > (edgeHistogramBuffer, frame, edgeCutoffBuffer);
+            // few pixels take the extra samples, smaller blocks keep the idle threads of a block down
+            uint32_t refineThreads = 16;
+            dim3 refineGrid{ (frame.width + refineThreads - 1) / refineThreads, (frame.height + refineThreads - 1) / refineThreads };
+            EdgeRefine << <refineGrid, dim3{ refineThreads, refineThreads } >> > (surfaceObject, frame, de, coneStart, tilesX, edgeContrastBuffer, edgeCutoffBuffer);
+        }
+    };
+    if (frame.instrumentation && !pixelCounterBuffer) checkCudaError(cudaMalloc(&pixelCounterBuffer, (size_t)imageWidth * imageHeight * sizeof(PixelCounters)));
+    if (frame.deepZoom) {
+        // the copy is ordered after the kernels of the previous frame that still read the old orbit
+        computeReferenceOrbit(frame, hostReferenceOrbit);
+        checkCudaError(cudaMemcpyAsync(referenceOrbitBuffer, &hostReferenceOrbit, sizeof(ReferenceOrbit), cudaMemcpyHostToDevice));
+        render(PerturbedMandelbulb{ referenceOrbitBuffer, frame.fractal, frame.fractal.minDistance });
+    } else if (frame.brickMap && deviceBrickMap.resolution > 0) {
+        // only the generic estimators, the specialized ones are about as fast as the lookups (see fractal/brick_map.h)
+        dispatchGenericEstimator(frame.fractal, [&](auto de) { render(CachedDistanceEstimator<decltype(de)>{ de, deviceBrickMap }); });
+    } else if (frame.genericKernel) {
+        dispatchGenericEstimator(frame.fractal, render);
+    } else {
+        dispatchDistanceEstimator(frame.fractal, render);
+    }
+    historyIndex ^= 1;
+
+    if (timed) {
+        checkCudaError(cudaEventRecord(renderEndEvent));
+        renderTimingPending = true;
+        pendingTiming.scale = sqrtf((float)frame.width * frame.height / ((float)imageWidth * imageHeight));
+        pendingTiming.fullFrame = fullFrame;
+    }
     checkCudaError(cudaGetLastError());
     //checkCudaError(cudaDeviceSynchronize()); // not optimal! should be synced with vulkan using semaphores
 
@@ -2,6 +2,9 @@
 #define CUDA_INTEROP_CUH
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
+#include "fractal/frame_constants.h"
+#include "fractal/brick_map.h"
+#include "fractal/pixel_counters.h"
 
 // Exports a vulkan memory allocation into CUDA. 
 // mem - native win32 handle to the memory allocation
@@ -13,7 +16,31 @@ void exportVulkanImageToCuda_R8G8B8A8Unorm(void* mem, VkDeviceSize size, VkDevic
 // frees the exported resources
 // the resources are stored in global variables for simplicity so resources must be freed before a new export
 void freeExportedVulkanImage();
-void renderCuda(float zoom, float offsetX, float offsetY, float t1, float t2, float t3, bool normal_surface);
+// true if there is a CUDA capable device. Without one the renderer falls back to the CPU backend
+bool isCudaAvailable();
+// renders the frame into the top left frame.width x frame.height corner of the exported image (at most its size)
+void renderCuda(const FrameConstants& frame);
+// loads the kernels renderCuda launches for the estimator of params (dispatchDistanceEstimator) without launching them,
+// the loader of the Renderer's KernelVariantCache. false if they could not be loaded
+bool loadCudaKernelVariant(const FractalParams& params);
+// copies the counters of the last renderCuda call with frame.instrumentation set to counters, count of them in rows of
+// frame.width. Waits for the kernel
+void readCudaPixelCounters(PixelCounters* counters, size_t count);
+// GPU time of a renderCuda call, measured with events, and the frame it was measured on
+struct CudaRenderTiming {
+    float milliseconds = 0.0f;
+    float scale = 1.0f; // rendered fraction of the image per axis, the DynamicResolution scale of the frame
+    bool fullFrame = false; // every pixel shaded, not one of the 2x2 progressive passes
+};
+
+// GPU time of the last renderCuda call that has finished by now. 0 before the first one
+float getCudaRenderMilliseconds();
+// the timing of the last renderCuda call that has finished by now, once: false if it was taken before.
+// Only one call in flight is timed at a time, the others have no timing
+bool takeCudaRenderTiming(CudaRenderTiming* timing);
+// copies the arrays of a host side brick map (BrickMapCache::view) to the device for the frames with brickMap set
+void uploadCudaBrickMap(const BrickMapView& map, size_t brickCount);
+void freeCudaBrickMap();
 
 void freeExportedSemaphores();
 void exportSemaphoresToCuda(void* cudaWaitsForVulkanSemaphoreHandle, void* vulkanWaitsForCudaSemaphoreHandle);
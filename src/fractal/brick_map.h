@@ -0,0 +1,93 @@
+#ifndef FRACTAL_BRICK_MAP_H
+#define FRACTAL_BRICK_MAP_H
+#include "fractal/mandelbulb.h"
+
+// Sparse brick map of the distance field (FrameConstants::brickMap), built by BrickMapCache (cpu/brick_map_cache.h).
+// The field only depends on the fractal parameters and objectRotation, not on the camera, so it is sampled once:
+//  - a coarse grid of resolution^3 cells over the cube around the bounding sphere, with the estimate at every cell centre
+//  - a brick of cBrickSamples^3 estimates for the cells close to the surface
+// Both give a lower bound of the estimate anywhere in a cell, which the march steps by in empty space. Close to the
+// surface the bound drops below refineDistance and the exact estimator takes over, the hits and normals are exact.
+// The bounds assume the estimate changes no faster than the distance (1-Lipschitz), like sphere tracing itself.
+// The bounds are smaller than the estimates, so rays take a few more steps, but only the ones near the surface are exact
+// (320x240, power 12, zoom 1: 5.3 estimates per ray without the map, 6.1 steps with 2.8 estimates with it). That only
+// pays off for a slow estimator on a scalar march. 640x360 with normals on one core, without -> with the map: the
+// generic trigonometric power 8 on the scalar CPU path 240 -> 219 ms in the full view (2358 -> 2450 ms in a close-up),
+// while the AVX-512 packets march it without the map in 77 ms and the default triplex power 12 in 33 ms (130 ms through
+// the map). The Mandelbox (+11%) and the quaternion Julia set (+14%) got slower with it, the Menger sponge gained 3%.
+// So the map is only used where brickMapPaysOff and the backends wrap the generic estimators (dispatchGenericEstimator)
+
+// fine cells per brick edge, neighbouring bricks both store the samples on their common face
+constexpr int cBrickCells = 8;
+constexpr int cBrickSamples = cBrickCells + 1;
+constexpr int cBrickSampleCount = cBrickSamples * cBrickSamples * cBrickSamples;
+
+// the fractals marched through the map: the Mandelbulbs without a specialized estimator. On the CPU only the scalar
+// path marches through it, the packets are faster without it
+inline bool brickMapPaysOff(const FractalParams& params)
+{
+    return params.type == FractalType::Mandelbulb && !isSpecialized(params);
+}
+
+// device or host pointers into the arrays of a BrickMapCache, resolution 0 if there is none
+struct BrickMapView {
+    glm::vec3 origin; // lower corner of the grid
+    float cellSize; // edge of a coarse cell
+    int resolution; // coarse cells per grid edge
+    float refineDistance; // bounds below this are replaced by the exact estimate
+    const float* centreDistance; // estimate at the centre of every coarse cell, x fastest
+    const int* brickIndex; // brick of every coarse cell or -1
+    const float* bricks; // cBrickSampleCount estimates per brick, x fastest
+};
+
+// lower bound of the distance estimate at pos, false outside the grid
+FRACTAL_FUNC bool brickMapBound(const BrickMapView& map, glm::vec3 pos, float* bound)
+{
+    glm::vec3 grid = (pos - map.origin) / map.cellSize;
+    if (!(grid.x >= 0.0f && grid.y >= 0.0f && grid.z >= 0.0f) || !(grid.x < map.resolution && grid.y < map.resolution && grid.z < map.resolution)) return false;
+    glm::ivec3 cell = glm::min(glm::ivec3(grid), glm::ivec3(map.resolution - 1));
+    int index = (cell.z * map.resolution + cell.y) * map.resolution + cell.x;
+
+    int brick = map.brickIndex[index];
+    if (brick < 0) {
+        // d(pos) >= d(centre) - |pos - centre|
+        *bound = map.centreDistance[index] - glm::length(grid - glm::vec3(cell) - 0.5f) * map.cellSize;
+        return true;
+    }
+
+    // trilinear interpolation of the 8 samples around pos. Each sample s bounds d(pos) >= d(s) - |pos - s|, the weighted
+    // distances sum to at most half the diagonal of a fine cell
+    glm::vec3 fine = glm::min((grid - glm::vec3(cell)) * (float)cBrickCells, glm::vec3(cBrickCells - 1e-3f));
+    glm::ivec3 corner = glm::ivec3(fine);
+    glm::vec3 w = fine - glm::vec3(corner);
+    const float* s = map.bricks + (size_t)brick * cBrickSampleCount + (corner.z * cBrickSamples + corner.y) * cBrickSamples + corner.x;
+    constexpr int dy = cBrickSamples, dz = cBrickSamples * cBrickSamples;
+    float x00 = s[0] + (s[1] - s[0]) * w.x;
+    float x10 = s[dy] + (s[dy + 1] - s[dy]) * w.x;
+    float x01 = s[dz] + (s[dz + 1] - s[dz]) * w.x;
+    float x11 = s[dz + dy] + (s[dz + dy + 1] - s[dz + dy]) * w.x;
+    float y0 = x00 + (x10 - x00) * w.y;
+    float y1 = x01 + (x11 - x01) * w.y;
+    *bound = y0 + (y1 - y0) * w.z - 0.8660254f * map.cellSize / (float)cBrickCells;
+    return true;
+}
+
+// DE through the brick map: the bound where it is above map.refineDistance, else the exact estimate of de
+template <typename DE>
+struct CachedDistanceEstimator {
+    DE de;
+    BrickMapView map;
+
+    // a lookup takes no iteration
+    FRACTAL_FUNC float operator()(glm::vec3 pos, const glm::mat3& rotation, int* iterationsDone = nullptr) const {
+        float bound;
+        if (brickMapBound(map, pos, &bound) && bound > map.refineDistance) {
+            if (iterationsDone) *iterationsDone = 0;
+            return bound;
+        }
+        return de(pos, rotation, iterationsDone);
+    }
+    FRACTAL_FUNC glm::vec3 gradient(glm::vec3 pos, const glm::mat3& rotation) const { return de.gradient(pos, rotation); }
+};
+
+#endif//FRACTAL_BRICK_MAP_H
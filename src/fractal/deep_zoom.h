@@ -0,0 +1,242 @@
+#ifndef FRACTAL_DEEP_ZOOM_H
+#define FRACTAL_DEEP_ZOOM_H
+#include "fractal/mandelbulb.h"
+
+// Deep zoom path (FrameConstants::deepZoom).
+// Single precision positions around the fractal are spaced ~1e-7 apart, past a zoom of a few thousand the pixel
+// footprint drops below that and the surface turns to noise. Doing everything in double would make every frame
+// 2x (CPU) to 32x (consumer GPUs) slower, so only a few values per frame and per ray are double:
+//  - host, once per frame (adaptToDeepZoom): a few rays across the image are marched in double, the nearest hit gives
+//    the reference point R. The orbit of R and the Jacobian of every iteration are computed in double (computeReferenceOrbit)
+//  - per ray: the direction and the closest approach of the ray to R are computed in double, the march itself runs in
+//    float in coordinates relative to R, where the float spacing is far below the footprint
+//  - the distance estimator (PerturbedMandelbulb) iterates the offset of the orbit from the orbit of R in float,
+//    linearized with the Jacobians, and the full orbit once the offset has grown large enough for float
+
+// FrameConstants::deepZoom is set once one pixel spans less than this angle (zoom ~200 at 1080p).
+// The float path is ~3 pixels off in depth there on surfaces away from the centre
+constexpr double cDeepZoomPixelAngle = 5e-6;
+// the deep path supports the whole range of the iteration slider
+constexpr int cMaxReferenceIterations = 64;
+// An orbit offset is iterated with the Jacobians of the reference orbit until it is this large, then the orbit itself
+// is iterated. The linearization error grows with the offset, the rounding error of the full orbit (~1e-7) relative
+// to it shrinks; both are ~1e-3 of the offset here
+constexpr float cPerturbationLimit = 1e-4f;
+
+// orbit of the reference point R, z_0 = objectRotation * R, z_i+1 = T(z_i) + R
+struct ReferenceOrbit {
+    int length; // z[0..length] and jacobian[0..length - 1] are valid, z[length] escaped or was the last iteration
+    glm::vec3 c; // R in float, for the orbits that outgrew the perturbation
+    glm::vec3 z[cMaxReferenceIterations + 1];
+    glm::mat3 jacobian[cMaxReferenceIterations]; // derivative of the power map T at z[i]
+};
+
+// the power map z -> z^power of the iteration, float, for the orbits iterated in full
+FRACTAL_FUNC glm::vec3 powerMap(glm::vec3 z, float radius, const FractalParams& params)
+{
+    if (params.formula == FormulaMode::Triplex && params.power == floorf(params.power)) return triplexPow(z, radius, (int)params.power);
+    float theta = acosf(z.z / radius) * params.power;
+    float phi = atan2f(z.y, z.x) * params.power;
+    return glm::vec3(sinf(theta) * cosf(phi), sinf(phi) * sinf(theta), cosf(theta)) * powf(radius, params.power);
+}
+
+// Distance estimator of the deep zoom path: pos is relative to the reference point R of orbit.
+// gradient() takes central differences at normalEpsilon, the dual number gradient would need the full orbit
+struct PerturbedMandelbulb {
+    const ReferenceOrbit* orbit;
+    FractalParams params;
+    float normalEpsilon;
+
+    FRACTAL_FUNC float operator()(glm::vec3 pos, const glm::mat3& rotation, int* iterationsDone = nullptr) const {
+        const ReferenceOrbit& reference = *orbit;
+        glm::vec3 offset = rotation * pos; // z_i - reference.z[i]
+        glm::vec3 z = glm::vec3(0.0f);
+        bool perturbed = true;
+        bool triplex = params.formula == FormulaMode::Triplex && params.power == floorf(params.power);
+
+        float derivative = 1.0f;
+        float radius = 0.0f;
+        int i;
+        for (i = 0; i < params.iterations; i++) {
+            if (perturbed && (i >= reference.length || glm::dot(offset, offset) > cPerturbationLimit * cPerturbationLimit)) {
+                z = reference.z[glm::min(i, reference.length)] + offset;
+                perturbed = false;
+            }
+            radius = glm::length(perturbed ? reference.z[i] + offset : z);
+            if (radius > 2.0f) break;
+            derivative = (triplex ? ipow(radius, (int)params.power - 1) : powf(radius, params.power - 1.0f)) * params.power * derivative + 1.0f;
+            if (perturbed) offset = reference.jacobian[i] * offset + pos;
+            else z = powerMap(z, radius, params) + reference.c + pos;
+        }
+        if (iterationsDone) *iterationsDone = i;
+        return 0.5f * logf(radius) * radius / derivative;
+    }
+
+    FRACTAL_FUNC glm::vec3 gradient(glm::vec3 pos, const glm::mat3& rotation) const {
+        const PerturbedMandelbulb& de = *this;
+        float e = normalEpsilon;
+        return glm::vec3(
+            de(glm::vec3(pos.x + e, pos.y, pos.z), rotation) - de(glm::vec3(pos.x - e, pos.y, pos.z), rotation),
+            de(glm::vec3(pos.x, pos.y + e, pos.z), rotation) - de(glm::vec3(pos.x, pos.y - e, pos.z), rotation),
+            de(glm::vec3(pos.x, pos.y, pos.z + e), rotation) - de(glm::vec3(pos.x, pos.y, pos.z - e), rotation));
+    }
+};
+
+// shadeSample for the deep zoom path, de is a PerturbedMandelbulb or a wrapper of one.
+// The ray is marched from its closest approach to R
+template <typename DE>
+FRACTAL_FUNC glm::vec4 shadePerturbedSample(float x, float y, const FrameConstants& frame, const DE& de, float* hitDistance, int* evaluations)
+{
+    double min_w_h = (double)glm::min(frame.width, frame.height);
+    double ar = (double)frame.width / (double)frame.height;
+    glm::dvec3 direction = glm::normalize(frame.deepRayTransform * glm::dvec3(x / min_w_h - ar * 0.5, y / min_w_h - 0.5, 1.0));
+    double closest = -glm::dot(frame.deepCamera, direction);
+
+    ray r;
+    r.origin = glm::vec3(frame.deepCamera + direction * closest);
+    r.direction = glm::vec3(direction);
+    glm::vec3 hitPos = r.origin;
+    float c = march(r, frame, de, (float)(frame.deepStart - closest), &hitPos, evaluations);
+    if (hitDistance) *hitDistance = c > 0.0f ? (float)closest + glm::dot(hitPos - r.origin, r.direction) : 0.0f;
+
+    // Analytic normals call de.gradient(), for PerturbedMandelbulb the differences at normalEpsilon
+    glm::vec3 normal = frame.normalSurface ? calculateNormal(hitPos, frame.objectRotation, de, NormalMode::Analytic) : glm::vec3(0.0f);
+    return colorPixel(c, normal, frame.normalSurface);
+}
+
+// picked by overload resolution for PerturbedMandelbulb so the backends can pass it to the same code as the other
+// estimators. start_dist and history are unused: adaptToDeepZoom turns the cone prepass off and the Renderer the reprojection
+FRACTAL_FUNC glm::vec4 shadeSample(float x, float y, const FrameConstants& frame, const PerturbedMandelbulb& de, float /*start_dist*/ = 0.0f,
+    const float* /*history*/ = nullptr, float* hitDistance = nullptr, int* evaluations = nullptr)
+{
+    return shadePerturbedSample(x, y, frame, de, hitDistance, evaluations);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// host side
+
+// power map in double, the trigonometric form is exact enough in double for every formula
+inline glm::dvec3 powerMapDouble(glm::dvec3 z, double power)
+{
+    double radius = glm::length(z);
+    double theta = std::acos(z.z / radius) * power;
+    double phi = std::atan2(z.y, z.x) * power;
+    return glm::dvec3(std::sin(theta) * std::cos(phi), std::sin(phi) * std::sin(theta), std::cos(theta)) * std::pow(radius, power);
+}
+
+// mandelbulb() in double, *iterationsDone receives the number of iterations before the orbit escaped
+inline double mandelbulbDouble(glm::dvec3 pos, const glm::dmat3& rotation, const FractalParams& params, int* iterationsDone = nullptr)
+{
+    glm::dvec3 z = rotation * pos;
+    double derivative = 1.0, radius = 0.0;
+    int i;
+    for (i = 0; i < params.iterations; i++) {
+        radius = glm::length(z);
+        if (radius > 2.0) break;
+        derivative = std::pow(radius, params.power - 1.0) * params.power * derivative + 1.0;
+        z = powerMapDouble(z, params.power) + pos;
+    }
+    if (iterationsDone) *iterationsDone = i;
+    return 0.5 * std::log(radius) * radius / derivative;
+}
+
+inline void computeReferenceOrbit(const FrameConstants& frame, ReferenceOrbit& orbit)
+{
+    glm::dvec3 c = frame.deepReference;
+    glm::dvec3 z = glm::dmat3(frame.objectRotation) * c;
+    int iterations = glm::min(frame.fractal.iterations, cMaxReferenceIterations);
+    orbit.c = glm::vec3(c);
+    orbit.length = 0;
+    orbit.z[0] = glm::vec3(z);
+    while (orbit.length < iterations && glm::length(z) <= 2.0) {
+        // central differences in double, ~1e-9 relative error, far below the float the Jacobian is stored in
+        double h = 1e-6 * glm::max(glm::length(z), 1e-3);
+        glm::dmat3 jacobian;
+        for (int axis = 0; axis < 3; ++axis) {
+            glm::dvec3 step = glm::dvec3(0.0);
+            step[axis] = h;
+            jacobian[axis] = (powerMapDouble(z + step, frame.fractal.power) - powerMapDouble(z - step, frame.fractal.power)) / (2.0 * h);
+        }
+        orbit.jacobian[orbit.length] = glm::mat3(jacobian);
+        z = powerMapDouble(z, frame.fractal.power) + c;
+        orbit.z[++orbit.length] = glm::vec3(z);
+    }
+}
+
+// Host side: switches frame to the deep zoom path if a pixel spans less than cDeepZoomPixelAngle.
+// rayTransform is FrameConstants::rayTransform in double precision (see buildRayTransform).
+// Call after adaptToPixelFootprint, the hit threshold becomes the fixed fractal.minDistance at the distance of R
+inline void adaptToDeepZoom(FrameConstants& frame, const glm::dmat4& rayTransform)
+{
+    glm::dvec3 camera = glm::dvec3(rayTransform[3]);
+    glm::dmat3 directions = glm::dmat3(rayTransform);
+    double zoom = glm::length(directions[2]) / glm::length(directions[0]);
+    double pixelAngle = 1.0 / (zoom * (double)glm::min(frame.width, frame.height));
+    // the perturbation is derived for the Mandelbulb iteration, the other formulas stay on the float path
+    frame.deepZoom = frame.fractal.type == FractalType::Mandelbulb && pixelAngle < cDeepZoomPixelAngle;
+    if (!frame.deepZoom) return;
+
+    double slope = frame.fractal.footprintEpsilon > 0.0f ? frame.fractal.footprintEpsilon * pixelAngle : 0.0;
+    glm::dmat3 rotation = glm::dmat3(frame.objectRotation);
+    FractalParams params = frame.fractal;
+    params.iterations = glm::min(params.iterations, cMaxReferenceIterations);
+
+    // every ray of the frame lies in a cone around the centre ray with the opening of the image diagonal,
+    // coneMarch() along it gives the start of every ray. Past the far side of the escape radius nothing is hit
+    double ar = (double)frame.width / (double)frame.height;
+    glm::dvec3 axis = glm::normalize(directions[2]);
+    double tanHalfAngle = glm::length(glm::dvec2(ar * 0.5, 0.5)) / glm::length(directions[2]);
+    double farthest = glm::length(camera) + 2.0;
+    int maxSteps = 16 * frame.fractal.maxRaySteps;
+    double start = 0.0;
+    for (int steps = 0; steps < maxSteps && start < farthest; ++steps) {
+        double distance = mandelbulbDouble(camera + axis * start, rotation, params);
+        double advance = (distance - start * tanHalfAngle) / (1.0 + tanHalfAngle);
+        if (advance < (slope > 0.0 ? start * slope : (double)frame.fractal.minDistance)) break;
+        start += advance;
+    }
+
+    // R near the surface most of the image shows: the nearest hit of 3 x 3 rays across the image
+    glm::dvec3 direction = axis;
+    double t = farthest;
+    for (int sample = 0; sample < 9; ++sample) {
+        glm::dvec3 d = glm::normalize(directions * glm::dvec3(((sample % 3) / 3.0 - 1.0 / 3.0) * ar, (sample / 3) / 3.0 - 1.0 / 3.0, 1.0));
+        double hit = start;
+        for (int steps = 0; steps < maxSteps && hit < t; ++steps) {
+            double distance = mandelbulbDouble(camera + d * hit, rotation, params);
+            if (distance < (slope > 0.0 ? hit * slope : (double)frame.fractal.minDistance)) {
+                t = hit;
+                direction = d;
+                break;
+            }
+            hit += distance;
+        }
+    }
+
+    // and behind that hit where the orbit runs longest, rays whose orbit outlasts the reference orbit are iterated in
+    // full float from there on. The candidates are 1, 2, 4, ... hit thresholds deep
+    glm::dvec3 reference = camera + direction * t;
+    int longest = -1;
+    double depth = t * glm::max(slope, 1e-12);
+    for (int k = 0; k < 32 && longest < params.iterations; ++k, depth *= 2.0) {
+        glm::dvec3 candidate = camera + direction * (t + depth);
+        int iterationsDone;
+        mandelbulbDouble(candidate, rotation, params, &iterationsDone);
+        if (iterationsDone > longest) {
+            longest = iterationsDone;
+            reference = candidate;
+        }
+    }
+
+    frame.deepReference = reference;
+    frame.deepCamera = camera - reference;
+    frame.deepRayTransform = directions;
+    frame.deepStart = start;
+    if (slope > 0.0) frame.fractal.minDistance = (float)(t * slope);
+    frame.footprintSlope = 0.0f;
+    frame.boundingRadius = 0.0f;
+    frame.conePrepass = false;
+    frame.fractal.iterations = params.iterations;
+}
+
+#endif//FRACTAL_DEEP_ZOOM_H
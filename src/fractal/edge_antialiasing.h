@@ -0,0 +1,98 @@
+#ifndef FRACTAL_EDGE_ANTIALIASING_H
+#define FRACTAL_EDGE_ANTIALIASING_H
+#include "fractal/mandelbulb.h"
+
+// Edge-adaptive supersampling of full frames (FrameConstants::edgeSamples, not with frame.progressive).
+// One sample per pixel aliases along silhouettes and creases, uniform supersampling pays for the flat regions too.
+// After the primary pass the backends run two more:
+//  - contrast: every pixel is compared with its 4 neighbours in colour (the colour holds the normal or the step count)
+//    and in hit distance (edgeContrast). Contrasts above frame.edgeThreshold are counted in a histogram
+//  - refinement: the pixels above a cutoff picked from the histogram trace edgeSamples more samples at
+//    the R2 offsets of the progressive refinement and average them with the primary one (antialiasEdge).
+//    The cutoff (edgeCutoffBin) keeps the refined pixels under frame.edgeBudget of the image, the strongest edges first
+// The histogram makes the cutoff independent of the order the pixels are processed in, both backends pick the same pixels
+
+constexpr int cEdgeHistogramBins = 32;
+// relative difference in hit distance that counts as much as the full colour range. Surfaces at a crease differ by a
+// few percent, neighbours on the same smooth surface by far less than a percent
+constexpr float cEdgeDepthScale = 10.0f;
+
+FRACTAL_FUNC glm::vec4 rgbaIntToFloat(unsigned int rgba)
+{
+    return glm::vec4((float)(rgba & 0xffu), (float)((rgba >> 8) & 0xffu), (float)((rgba >> 16) & 0xffu), (float)(rgba >> 24)) / 255.0f;
+}
+
+// Contrast of pixel (x, y) of a frame.width x frame.height image against its 4 neighbours, 0 to 1.
+// texel(x, y) returns the packed colour of a pixel, hitDistance has rows of frame.width (0 for misses)
+template <typename Texels>
+FRACTAL_FUNC float edgeContrast(unsigned int x, unsigned int y, const FrameConstants& frame, const Texels& texel, const float* hitDistance)
+{
+    unsigned int color = texel(x, y);
+    float depth = hitDistance[y * frame.width + x];
+    int colorContrast = 0; // largest difference of a channel, 0 to 255
+    float depthContrast = 0.0f;
+    // neighbours past the border are clamped to the pixel itself, which adds no contrast
+    unsigned int left = x > 0 ? x - 1 : x, right = x + 1 < frame.width ? x + 1 : x;
+    unsigned int up = y > 0 ? y - 1 : y, down = y + 1 < frame.height ? y + 1 : y;
+    const unsigned int nx[4] = { left, right, x, x }, ny[4] = { y, y, up, down };
+    for (int i = 0; i < 4; ++i) {
+        unsigned int neighbour = texel(nx[i], ny[i]);
+        for (int shift = 0; shift < 24; shift += 8) colorContrast = glm::max(colorContrast, abs((int)((color >> shift) & 0xffu) - (int)((neighbour >> shift) & 0xffu)));
+        float neighbourDepth = hitDistance[ny[i] * frame.width + nx[i]];
+        float nearer = glm::min(depth, neighbourDepth), farther = glm::max(depth, neighbourDepth);
+        // a miss next to a hit is a silhouette
+        float contrast = nearer > 0.0f ? cEdgeDepthScale * (farther - nearer) / farther : farther > 0.0f ? 1.0f : 0.0f;
+        depthContrast = glm::max(depthContrast, contrast);
+    }
+    return glm::min(glm::max((float)colorContrast * (1.0f / 255.0f), depthContrast), 1.0f);
+}
+
+// histogram bin of a contrast above frame.edgeThreshold, linear from the threshold to 1
+FRACTAL_FUNC int edgeHistogramBin(float contrast, const FrameConstants& frame)
+{
+    float t = (contrast - frame.edgeThreshold) / glm::max(1.0f - frame.edgeThreshold, 1e-6f);
+    return glm::clamp((int)(t * (float)cEdgeHistogramBins), 0, cEdgeHistogramBins - 1);
+}
+
+// Lowest refined histogram bin: the pixels of it and of every bin above still fit frame.edgeBudget, the strongest
+// edges win. cEdgeHistogramBins (nothing is refined) if the top bin alone exceeds the budget
+FRACTAL_FUNC int edgeCutoffBin(const unsigned int* histogram, const FrameConstants& frame)
+{
+    float budget = frame.edgeBudget * (float)frame.width * (float)frame.height;
+    float refined = 0.0f;
+    int bin = cEdgeHistogramBins;
+    while (bin > 0 && refined + (float)histogram[bin - 1] <= budget) refined += (float)histogram[--bin];
+    return bin;
+}
+
+// whether a pixel of the given contrast is refined with the cutoff of edgeCutoffBin
+FRACTAL_FUNC bool isRefinedEdge(float contrast, int cutoffBin, const FrameConstants& frame)
+{
+    return contrast > frame.edgeThreshold && edgeHistogramBin(contrast, frame) >= cutoffBin;
+}
+
+// sub pixel offset of edge sample i > 0 of a pixel, the primary sample is the centre
+FRACTAL_FUNC glm::vec2 edgeSampleJitter(unsigned int i)
+{
+    return refinementJitter(cRefinementSubsets - 1 + i);
+}
+
+// primary averaged with frame.edgeSamples more samples of pixel (x, y). start is the safe start of the pixel (cone prepass).
+// evaluations receives the distance estimates of the extra samples
+template <typename DE>
+FRACTAL_FUNC glm::vec4 antialiasEdge(unsigned int x, unsigned int y, const FrameConstants& frame, const DE& de, glm::vec4 primary, float start,
+    int* evaluations = nullptr)
+{
+    glm::vec4 sum = primary;
+    int total = 0;
+    for (unsigned int i = 1; i <= frame.edgeSamples; ++i) {
+        glm::vec2 jitter = edgeSampleJitter(i);
+        int sampleEvaluations = 0;
+        sum += shadeSample((float)x + jitter.x, (float)y + jitter.y, frame, de, start, nullptr, nullptr, &sampleEvaluations);
+        total += sampleEvaluations;
+    }
+    if (evaluations) *evaluations = total;
+    return sum / (float)(frame.edgeSamples + 1);
+}
+
+#endif//FRACTAL_EDGE_ANTIALIASING_H
@@ -0,0 +1,142 @@
+#ifndef FRACTAL_FORMULAS_H
+#define FRACTAL_FORMULAS_H
+#include <glm/glm.hpp>
+#include <cmath>
+#include "fractal/fractal_func.h"
+#include "fractal/fractal_params.h"
+
+// Distance estimators of the fractals besides the Mandelbulb (FractalParams::type). They have the interface of the
+// Mandelbulb functors in fractal/mandelbulb.h:
+//  - operator()(pos, rotation, iterationsDone): the estimate. Here rotation turns the whole fractal, unlike the
+//    Mandelbulb, where it only turns z0 and changes its shape
+//  - gradient(pos, rotation): the gradient of the estimate for NormalMode::Analytic
+// dispatchDistanceEstimator switches on the type once per frame on the host and every march, kernel and normal is
+// instantiated per functor, so the estimate inlines into the march loop without a switch or a virtual call in it.
+// Like the Mandelbulb they fit the view of the default camera (3 units from the origin) and a sphere of
+// fractalBoundingRadius
+
+// CRTP base of the formulas without a dual number iteration: the gradient of Derived::operator() by central
+// differences, 6 estimates per normal (see cGradientTaps in fractal/pixel_counters.h)
+template <typename Derived>
+struct NumericalGradient {
+    FRACTAL_FUNC glm::vec3 gradient(glm::vec3 pos, const glm::mat3& rotation) const {
+        const Derived& de = static_cast<const Derived&>(*this);
+        const float h = 1e-4f;
+        return glm::vec3(
+            de(glm::vec3(pos.x + h, pos.y, pos.z), rotation) - de(glm::vec3(pos.x - h, pos.y, pos.z), rotation),
+            de(glm::vec3(pos.x, pos.y + h, pos.z), rotation) - de(glm::vec3(pos.x, pos.y - h, pos.z), rotation),
+            de(glm::vec3(pos.x, pos.y, pos.z + h), rotation) - de(glm::vec3(pos.x, pos.y, pos.z - h), rotation)) / (2.0f * h);
+    }
+};
+
+// Mandelbox: z -> scale * sphereFold(boxFold(z)) + c. The box fold reflects the components beyond +-1, the sphere fold
+// inverts z in the unit sphere and scales the inner sphere of radius 0.5 up by 4
+constexpr float cBoxMinRadius2 = 0.25f;
+constexpr float cBoxFixedRadius2 = 1.0f;
+// the orbit never returns from beyond this radius (squared) for |scale| <= 4
+constexpr float cBoxEscapeRadius2 = 1e4f;
+
+// half edge of the cube around the origin holding the Mandelbox of the given scale
+FRACTAL_FUNC float mandelboxExtent(float scale)
+{
+    return scale > 1.0f ? 2.0f * (scale + 1.0f) / (scale - 1.0f) : 2.0f;
+}
+
+// scaled down by mandelboxExtent into the cube [-1, 1]^3 of the Menger sponge, the estimate is scaled back.
+// c = z0 = the rotated position
+struct Mandelbox : NumericalGradient<Mandelbox> {
+    FractalParams params;
+
+    FRACTAL_FUNC float operator()(glm::vec3 pos, const glm::mat3& rotation, int* iterationsDone = nullptr) const {
+        float extent = mandelboxExtent(params.boxScale);
+        glm::vec3 c = rotation * pos * extent;
+        glm::vec3 z = c;
+        float derivative = 1.0f;
+
+        int i;
+        for (i = 0; i < params.iterations; i++) {
+            float r2 = glm::dot(z, z);
+            if (r2 > cBoxEscapeRadius2) break;
+
+            z = glm::clamp(z, -1.0f, 1.0f) * 2.0f - z;
+            r2 = glm::dot(z, z);
+            float fold = r2 < cBoxMinRadius2 ? cBoxFixedRadius2 / cBoxMinRadius2 : r2 < cBoxFixedRadius2 ? cBoxFixedRadius2 / r2 : 1.0f;
+            z = z * (params.boxScale * fold) + c;
+            derivative = derivative * fabsf(params.boxScale) * fold + 1.0f;
+        }
+        if (iterationsDone) *iterationsDone = i;
+        return glm::length(z) / derivative / extent;
+    }
+};
+
+// quaternion q = (real, i, j, k) squared
+FRACTAL_FUNC glm::vec4 quaternionSquare(glm::vec4 q)
+{
+    return glm::vec4(q.x * q.x - q.y * q.y - q.z * q.z - q.w * q.w, 2.0f * q.x * q.y, 2.0f * q.x * q.z, 2.0f * q.x * q.w);
+}
+
+// escape radius (squared) of the quaternion Julia iteration, larger than the set (formulaBoundingRadius) for |c| < 12
+constexpr float cJuliaEscapeRadius2 = 16.0f;
+
+// 3D slice (k = 0) of the quaternion Julia set of q -> q^2 + params.juliaC, z0 = (pos.x, pos.y, pos.z, 0)
+struct QuaternionJulia : NumericalGradient<QuaternionJulia> {
+    FractalParams params;
+
+    FRACTAL_FUNC float operator()(glm::vec3 pos, const glm::mat3& rotation, int* iterationsDone = nullptr) const {
+        glm::vec4 q = glm::vec4(rotation * pos, 0.0f);
+        float r2 = glm::dot(q, q);
+        float derivative = 1.0f; // |q'|, |(q^2)'| = 2 |q| |q'|
+
+        int i;
+        for (i = 0; i < params.iterations; i++) {
+            if (r2 > cJuliaEscapeRadius2) break;
+            derivative *= 2.0f * sqrtf(r2);
+            q = quaternionSquare(q) + params.juliaC;
+            r2 = glm::dot(q, q);
+        }
+        if (iterationsDone) *iterationsDone = i;
+        float radius = sqrtf(r2);
+        return 0.5f * logf(radius) * radius / derivative;
+    }
+};
+
+// Menger sponge in the cube [-1, 1]^3: the exact distance to the cube with the crosses of every level removed
+// (one level per iteration, every level a third of the one before). Nothing escapes, iterationsDone is params.iterations
+struct MengerSponge : NumericalGradient<MengerSponge> {
+    FractalParams params;
+
+    FRACTAL_FUNC float operator()(glm::vec3 pos, const glm::mat3& rotation, int* iterationsDone = nullptr) const {
+        glm::vec3 z = rotation * pos;
+        glm::vec3 outside = glm::abs(z) - 1.0f;
+        float distance = glm::length(glm::max(outside, 0.0f)) + glm::min(glm::max(outside.x, glm::max(outside.y, outside.z)), 0.0f);
+
+        float scale = 1.0f;
+        for (int i = 0; i < params.iterations; i++) {
+            // position in the cell of this level, the cross through the cell centre is removed
+            glm::vec3 a = glm::mod(z * scale, 2.0f) - 1.0f;
+            scale *= 3.0f;
+            glm::vec3 r = glm::abs(1.0f - 3.0f * glm::abs(a));
+            float cross = (glm::min(glm::max(r.x, r.y), glm::min(glm::max(r.y, r.z), glm::max(r.z, r.x))) - 1.0f) / scale;
+            distance = glm::max(distance, cross);
+        }
+        if (iterationsDone) *iterationsDone = params.iterations;
+        return distance;
+    }
+};
+
+// radius of a sphere around the origin holding the fractal of params, for the types besides the Mandelbulb
+inline float formulaBoundingRadius(const FractalParams& params)
+{
+    switch (params.type) {
+    case FractalType::QuaternionJulia: {
+        // |q|^2 - |c| > |q| beyond this radius, the orbit grows in every iteration
+        float c = glm::length(params.juliaC);
+        return 0.5f * (1.0f + sqrtf(1.0f + 4.0f * c)) + 0.1f;
+    }
+    default:
+        // the corners of the cube [-1, 1]^3
+        return 1.7320508f + 0.1f;
+    }
+}
+
+#endif//FRACTAL_FORMULAS_H
@@ -0,0 +1,22 @@
+#ifndef FRACTAL_FUNC_H
+#define FRACTAL_FUNC_H
+
+// qualifiers of the code shared by the CUDA kernels and the CPU backend (fractal/mandelbulb.h, fractal/formulas.h)
+#ifdef __CUDACC__
+#define FRACTAL_FUNC __host__ __device__ inline
+#else
+#define FRACTAL_FUNC inline
+#endif
+
+// fully unrolls the following loop if its trip count is known at compile time
+#if defined(__CUDACC__)
+#define FRACTAL_UNROLL _Pragma("unroll")
+#elif defined(__clang__)
+#define FRACTAL_UNROLL _Pragma("clang loop unroll(full)")
+#elif defined(__GNUC__)
+#define FRACTAL_UNROLL _Pragma("GCC unroll 64")
+#else
+#define FRACTAL_UNROLL
+#endif
+
+#endif//FRACTAL_FUNC_H
@@ -0,0 +1,83 @@
+#ifndef FRACTAL_PARAMS_H
+#define FRACTAL_PARAMS_H
+#include <glm/glm.hpp>
+
+// The fractal rendered, each has its own distance estimator (fractal/mandelbulb.h, fractal/formulas.h)
+enum class FractalType : int {
+    Mandelbulb,
+    Mandelbox,
+    QuaternionJulia,
+    MengerSponge
+};
+constexpr int cFractalTypeCount = 4;
+
+inline const char* toString(FractalType type)
+{
+    switch (type) {
+    case FractalType::Mandelbox: return "mandelbox";
+    case FractalType::QuaternionJulia: return "quaternion_julia";
+    case FractalType::MengerSponge: return "menger_sponge";
+    default: return "mandelbulb";
+    }
+}
+
+// How one iteration of the power map z -> z^power + c of the Mandelbulb is evaluated
+enum class FormulaMode : int {
+    // spherical coordinates with acos/atan2/pow/sin/cos, works for any power
+    Trigonometric,
+    // polynomial triplex algebra, only multiplications and two square roots per iteration.
+    // Integer powers only, non integer powers fall back to Trigonometric
+    Triplex
+};
+
+// How the surface normal at a hit position is computed
+enum class NormalMode : int {
+    // six extra distance estimates, central differences with a fixed 0.0005 step
+    CentralDifferences,
+    // exact gradient of the distance estimate, the iteration is run once with dual numbers
+    Analytic
+};
+
+// Runtime parameters of the fractal and the ray marcher, shared by the CUDA and the CPU backend.
+// Combinations listed in dispatchDistanceEstimator (fractal/mandelbulb.h) run a kernel specialized at compile time,
+// everything else runs the generic one
+struct FractalParams {
+    FractalType type = FractalType::Mandelbulb;
+    // Mandelbulb
+    FormulaMode formula = FormulaMode::Triplex;
+    float power = 12.0f;
+    // Mandelbox: scale of the iteration, |scale| > 1. 2 is the classic box, negative scales give denser ones
+    float boxScale = 2.0f;
+    // quaternion Julia set: the constant c of q -> q^2 + c, real part first
+    glm::vec4 juliaC = glm::vec4(-0.291f, -0.399f, 0.339f, 0.437f);
+    // iterations of every formula, the Menger sponge removes one level of cubes per iteration
+    int iterations = 12;
+    int maxRaySteps = 50;
+    // a ray hits the surface once the distance estimate drops below this
+    float minDistance = 0.0005f;
+    NormalMode normalMode = NormalMode::Analytic;
+    // hit threshold in pixels instead: a ray hits once the estimate drops below this fraction of the width of its pixel
+    // at the current distance, so far hits stop at the detail a pixel can show and zooming in resolves more of it.
+    // 0 uses the fixed minDistance. See adaptToPixelFootprint (fractal/mandelbulb.h)
+    float footprintEpsilon = 0.5f;
+    // march() steps this multiple of the distance estimate and falls back to 1 where that is not safe, 1 disables it.
+    // 1.2 to 1.6 save steps on distance estimated surfaces
+    float overRelaxation = 1.0f;
+    // maxRaySteps is the budget at zoom 1, every doubling of the zoom adds cStepsPerZoomOctave of it
+    bool adaptiveSteps = true;
+};
+
+inline bool operator==(const FractalParams& a, const FractalParams& b)
+{
+    return a.type == b.type && a.formula == b.formula && a.power == b.power && a.boxScale == b.boxScale && a.juliaC == b.juliaC &&
+        a.iterations == b.iterations && a.maxRaySteps == b.maxRaySteps &&
+        a.minDistance == b.minDistance && a.normalMode == b.normalMode && a.footprintEpsilon == b.footprintEpsilon &&
+        a.adaptiveSteps == b.adaptiveSteps && a.overRelaxation == b.overRelaxation;
+}
+
+inline bool operator!=(const FractalParams& a, const FractalParams& b)
+{
+    return !(a == b);
+}
+
+#endif//FRACTAL_PARAMS_H
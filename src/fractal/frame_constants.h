@@ -0,0 +1,146 @@
+#ifndef FRACTAL_FRAME_CONSTANTS_H
+#define FRACTAL_FRAME_CONSTANTS_H
+#include <glm/glm.hpp>
+#include <cstdint>
+#include "fractal/fractal_params.h"
+
+// the per pixel counters of an instrumented frame, see fractal/pixel_counters.h
+enum class PixelCounter : int {
+    MarchSteps, DEIterations, EscapeIteration, NormalTaps
+};
+constexpr int cPixelCounterCount = 4;
+
+// Everything a backend needs to render one frame. Built once per frame on the host (Renderer::render)
+// and passed unchanged to every backend; the CUDA kernel receives it as a kernel parameter (constant bank).
+struct FrameConstants {
+    // camera to world times the inverse projection: maps (u, v, 1, 0) on the image plane to the world space ray
+    // direction (not normalized) and (0, 0, 0, 1) to the camera position.
+    // u, v are pixel coordinates centered on the image and divided by its shorter side
+    glm::mat4 rayTransform;
+    // world to fractal space for the starting point of the iteration, z0 = objectRotation * pos.
+    // c stays in world space, so the rotation changes the shape of the set
+    glm::mat3 objectRotation;
+    FractalParams fractal;
+    // rays are clipped to this sphere around the origin, 0 disables clipping. See fractalBoundingRadius
+    float boundingRadius;
+    uint32_t width, height;
+    // hit threshold per unit of ray length, fractal.footprintEpsilon times the angle of a pixel. 0 uses fractal.minDistance,
+    // see hitThreshold
+    float footprintSlope;
+    bool normalSurface;
+    // march a cone per cConeTileSize^2 pixel tile first and start the pixel rays at its distance, see coneMarch
+    bool conePrepass;
+    // start the pixel rays near the hit distance of the previous frame, see reprojectStart. Only set by the Renderer
+    // if the previous frame was rendered by the same backend at the same size with the same fractal and camera position
+    bool reprojection;
+    // inverse of the direction part (upper 3x3) of the previous frame's rayTransform, valid if reprojection is set
+    glm::mat3 previousInverseRay;
+    // spacing of the shaded pixels of the previous frame: 2 after progressive pass 0, which fills each 2x2 block with one
+    // sample, else 1. Valid if reprojection is set
+    uint32_t historyStep;
+    // render only the part of the image given by refinementPass and refine the previous passes, see cRefinementSubsets
+    bool progressive;
+    uint32_t refinementPass;
+    // march the rays relative to the reference point deepReference near the surface, see fractal/deep_zoom.h.
+    // Set by adaptToDeepZoom past cDeepZoomPixelAngle, the other deep fields are only valid with it
+    bool deepZoom;
+    glm::dvec3 deepReference;
+    // camera position relative to deepReference
+    glm::dvec3 deepCamera;
+    // direction part of rayTransform in double precision
+    glm::dmat3 deepRayTransform;
+    // distance from the camera every ray can skip, the cone around all rays is empty up to there
+    double deepStart;
+    // march through the brick map the backend was given (setCpuBrickMap / uploadCudaBrickMap), see fractal/brick_map.h
+    bool brickMap;
+    // write the per pixel counters of fractal/pixel_counters.h to the counter buffer of the backend (getCpuPixelCounters,
+    // readCudaPixelCounters). The CPU backend marches the instrumented pixels with the scalar code instead of the packets
+    bool instrumentation;
+    // with instrumentation: colour the pixels by heatmapCounter, from blue at 0 to red at heatmapMax (0: its natural
+    // maximum, see heatmapColor) over the shaded image
+    bool heatmap;
+    PixelCounter heatmapCounter;
+    float heatmapMax;
+    // edge-adaptive supersampling of full frames, see fractal/edge_antialiasing.h: pixels whose contrast to a neighbour
+    // exceeds edgeThreshold get edgeSamples more samples, at most edgeBudget of the pixels. edgeSamples 0 disables it
+    uint32_t edgeSamples;
+    float edgeThreshold;
+    float edgeBudget;
+    // CUDA backend: render with the generic estimator (dispatchGenericEstimator) while the kernels specialized for
+    // fractal are loaded in the background, see KernelVariantCache. The same fractal up to rounding, not in hashImage
+    bool genericKernel;
+};
+
+// FNV-1a hash of everything in frame that changes the rendered image. Frames with the same hash render the same
+// image, the per frame bookkeeping (reprojection, refinement) is left out. Fields are added one by one, padding never counts
+inline uint64_t hashImage(const FrameConstants& frame)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const auto& value) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t i = 0; i < sizeof(value); ++i) hash = (hash ^ bytes[i]) * 1099511628211ull;
+    };
+    add(frame.rayTransform);
+    add(frame.objectRotation);
+    add(frame.fractal.type);
+    add(frame.fractal.formula);
+    add(frame.fractal.power);
+    add(frame.fractal.boxScale);
+    add(frame.fractal.juliaC);
+    add(frame.fractal.iterations);
+    add(frame.fractal.maxRaySteps);
+    add(frame.fractal.minDistance);
+    add(frame.fractal.normalMode);
+    add(frame.fractal.footprintEpsilon);
+    add(frame.fractal.adaptiveSteps);
+    add(frame.fractal.overRelaxation);
+    add(frame.boundingRadius);
+    add(frame.width);
+    add(frame.height);
+    add(frame.footprintSlope);
+    add(frame.normalSurface);
+    add(frame.conePrepass);
+    add(frame.deepZoom);
+    add(frame.brickMap);
+    // the counter buffer only matches the image if it was written by the same frame
+    add(frame.instrumentation);
+    add(frame.heatmap);
+    add(frame.heatmapCounter);
+    add(frame.heatmapMax);
+    add(frame.edgeSamples);
+    add(frame.edgeThreshold);
+    add(frame.edgeBudget);
+    return hash;
+}
+
+// Camera looking down +x from (-3, 0.05, 0.05), image u along +y and v along +z.
+// zoom moves the image plane away from the eye, offsetX/Y shift it.
+// Double precision for the deep zoom path, FrameConstants::rayTransform is the float conversion
+inline glm::dmat4 buildRayTransform(double zoom, double offsetX, double offsetY)
+{
+    glm::dmat4 cameraToWorld = glm::dmat4(
+        glm::dvec4(0.0, 1.0, 0.0, 0.0),
+        glm::dvec4(0.0, 0.0, 1.0, 0.0),
+        glm::dvec4(1.0, 0.0, 0.0, 0.0),
+        glm::dvec4(-3.0, 0.05, 0.05, 1.0));
+    glm::dmat4 inverseProjection = glm::dmat4(
+        glm::dvec4(1.0, 0.0, 0.0, 0.0),
+        glm::dvec4(0.0, 1.0, 0.0, 0.0),
+        glm::dvec4(offsetX, offsetY, zoom, 0.0),
+        glm::dvec4(0.0, 0.0, 0.0, 1.0));
+    return cameraToWorld * inverseProjection;
+}
+
+// rotation by angles.x around x, then angles.y around y (clockwise) and angles.z around z
+inline glm::mat3 buildObjectRotation(glm::vec3 angles)
+{
+    float cx = cosf(angles.x), sx = sinf(angles.x);
+    float cy = cosf(angles.y), sy = sinf(angles.y);
+    float cz = cosf(angles.z), sz = sinf(angles.z);
+    glm::mat3 rx = glm::mat3(1.0f, 0.0f, 0.0f, 0.0f, cx, sx, 0.0f, -sx, cx);
+    glm::mat3 ry = glm::mat3(cy, 0.0f, sy, 0.0f, 1.0f, 0.0f, -sy, 0.0f, cy);
+    glm::mat3 rz = glm::mat3(cz, sz, 0.0f, -sz, cz, 0.0f, 0.0f, 0.0f, 1.0f);
+    return rz * ry * rx;
+}
+
+#endif//FRACTAL_FRAME_CONSTANTS_H
@@ -0,0 +1,643 @@
+#ifndef FRACTAL_MANDELBULB_H
+#define FRACTAL_MANDELBULB_H
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cfloat>
+#include "fractal/fractal_params.h"
+#include "fractal/frame_constants.h"
+#include "fractal/fractal_func.h"
+#include "fractal/formulas.h"
+
+// Everything in this header is compiled twice: by nvcc for the CUDA kernel and by the host compiler for the CPU backend.
+// Keep it free of host only (std containers, logging) and device only (intrinsics, surfaces) code.
+
+// compresses 4 32bit floats into a 32bit uint
+FRACTAL_FUNC unsigned int rgbaFloatToInt(glm::vec4 rgba) {
+    rgba = glm::clamp(rgba, glm::vec4(0.0f), glm::vec4(1.0f)); // clamp to [0.0, 1.0]
+    return ((unsigned int)(rgba.w * 255.0f) << 24) |
+        ((unsigned int)(rgba.z * 255.0f) << 16) |
+        ((unsigned int)(rgba.y * 255.0f) << 8) |
+        ((unsigned int)(rgba.x * 255.0f));
+}
+
+typedef struct {
+    glm::vec3 origin;
+    glm::vec3 direction;
+} ray;
+
+// ray through (u, v) on the image plane, see FrameConstants::rayTransform
+FRACTAL_FUNC ray get_ray(float u, float v, const glm::mat4& rayTransform) {
+    ray r;
+    r.origin = glm::vec3(rayTransform[3]);
+    r.direction = glm::normalize(glm::vec3(rayTransform * glm::vec4(u, v, 1.0f, 0.0f)));
+    return r;
+}
+
+// x^n for n >= 0 by repeated squaring
+FRACTAL_FUNC float ipow(float x, int n) {
+    float result = 1.0f;
+    while (n > 0) {
+        if (n & 1) result *= x;
+        x *= x;
+        n >>= 1;
+    }
+    return result;
+}
+
+// x^N with N known at compile time, a fixed chain of multiplications
+template <int N>
+FRACTAL_FUNC float ipow(float x) {
+    if constexpr (N == 0) return 1.0f;
+    else if constexpr (N % 2 == 0) {
+        float half = ipow<N / 2>(x);
+        return half * half;
+    }
+    else return x * ipow<N - 1>(x);
+}
+
+FRACTAL_FUNC glm::vec2 complexMul(glm::vec2 a, glm::vec2 b) {
+    return glm::vec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+// (a.x + a.y i)^n for n >= 0 by repeated squaring
+FRACTAL_FUNC glm::vec2 complexPow(glm::vec2 a, int n) {
+    glm::vec2 result = glm::vec2(1.0f, 0.0f);
+    while (n > 0) {
+        if (n & 1) result = complexMul(result, a);
+        a = complexMul(a, a);
+        n >>= 1;
+    }
+    return result;
+}
+
+// (a.x + a.y i)^N with N known at compile time
+template <int N>
+FRACTAL_FUNC glm::vec2 complexPow(glm::vec2 a) {
+    if constexpr (N == 0) return glm::vec2(1.0f, 0.0f);
+    else if constexpr (N % 2 == 0) {
+        glm::vec2 half = complexPow<N / 2>(a);
+        return complexMul(half, half);
+    }
+    else return complexMul(a, complexPow<N - 1>(a));
+}
+
+// Power map of the trigonometric iteration without transcendental functions.
+// With rho = |z.xy|: cos(theta) + i sin(theta) = (z.z + i rho) / r and cos(phi) + i sin(phi) = (z.x + i z.y) / rho,
+// so sin/cos of n * theta and n * phi are the real and imaginary parts of their n-th complex powers (de Moivre).
+// Error bound (power 12, float, against a double precision trigonometric reference, 10^6 random points):
+//  - one power map: relative error <= 2e-6 (~32 ulp), the float trigonometric version reaches 3.4e-4 because acos is
+//    ill conditioned near the poles and the angle errors are multiplied by the power
+//  - full distance estimate (12 iterations, [-1.5, 1.5]^3): median absolute error 6.7e-8, 99.9th percentile 2.9e-6
+//    (trigonometric: 2.6e-8 and 7.4e-6). Both versions have rare outliers up to ~0.15 on the boundary of the set,
+//    where the iteration is chaotic and any rounding difference changes the escape iteration
+FRACTAL_FUNC glm::vec3 triplexPow(glm::vec3 z, float radius, int power) {
+    float rho = sqrtf(z.x * z.x + z.y * z.y);
+    glm::vec2 polar = complexPow(glm::vec2(z.z, rho) / radius, power); // cos(n theta), sin(n theta)
+    glm::vec2 azimuth = rho > 0.0f ? complexPow(glm::vec2(z.x, z.y) / rho, power) : glm::vec2(1.0f, 0.0f); // cos(n phi), sin(n phi)
+    return glm::vec3(polar.y * azimuth.x, polar.y * azimuth.y, polar.x) * ipow(radius, power);
+}
+
+template <int Power>
+FRACTAL_FUNC glm::vec3 triplexPow(glm::vec3 z, float radius) {
+    float rho = sqrtf(z.x * z.x + z.y * z.y);
+    glm::vec2 polar = complexPow<Power>(glm::vec2(z.z, rho) / radius);
+    glm::vec2 azimuth = rho > 0.0f ? complexPow<Power>(glm::vec2(z.x, z.y) / rho) : glm::vec2(1.0f, 0.0f);
+    return glm::vec3(polar.y * azimuth.x, polar.y * azimuth.y, polar.x) * ipow<Power>(radius);
+}
+
+// Distance estimators: rotation is FrameConstants::objectRotation, applied to the starting point z0 only.
+// iterationsDone (optional) receives the number of iterations before the orbit escaped, params.iterations if it never did
+
+// generic distance estimator, power, iteration count and formula are read at runtime
+FRACTAL_FUNC float mandelbulb(glm::vec3 pos, const glm::mat3& rotation, const FractalParams& params, int* iterationsDone = nullptr) {
+    glm::vec3 z = rotation * pos;
+
+    float derivative = 1.0f;
+    float radius = 0.0f;
+    float power = params.power;
+    bool triplex = params.formula == FormulaMode::Triplex && power == floorf(power);
+
+    int i;
+    for (i = 0; i < params.iterations; i++) {
+
+        radius = glm::length(z);
+
+        if (radius > 2.0f) break;
+
+        if (triplex) {
+            int n = (int)power;
+            derivative = ipow(radius, n - 1) * power * derivative + 1.0f;
+            z = triplexPow(z, radius, n) + pos;
+            continue;
+        }
+
+        // convert to spherical coordinates
+        float theta = acosf(z.z / radius);
+        float phi = atan2f(z.y, z.x);
+        derivative = powf(radius, power - 1.0f) * power * derivative + 1.0f;
+
+        // scale and rotate the point
+        float zr = powf(radius, power);
+        theta = theta * power;
+        phi = phi * power;
+
+        // convert back to cartesian coordinates
+        z = glm::vec3(sinf(theta) * cosf(phi), sinf(phi) * sinf(theta), cosf(theta)) * zr;
+
+        z = z + pos;
+    }
+    if (iterationsDone) *iterationsDone = i;
+    return 0.5f * logf(radius) * radius / derivative;
+}
+
+// Triplex distance estimator specialized for a fixed power and iteration count:
+// the iteration loop is unrolled and the power map becomes a fixed chain of multiplications without loop control
+template <int Power, int Iterations>
+FRACTAL_FUNC float mandelbulb(glm::vec3 pos, const glm::mat3& rotation, int* iterationsDone = nullptr) {
+    glm::vec3 z = rotation * pos;
+
+    float derivative = 1.0f;
+    float radius = 0.0f;
+
+    int i;
+    FRACTAL_UNROLL
+    for (i = 0; i < Iterations; i++) {
+        radius = glm::length(z);
+        if (radius > 2.0f) break;
+        derivative = ipow<Power - 1>(radius) * (float)Power * derivative + 1.0f;
+        z = triplexPow<Power>(z, radius) + pos;
+    }
+    if (iterationsDone) *iterationsDone = i;
+    return 0.5f * logf(radius) * radius / derivative;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Dual numbers: a value and its gradient with respect to the sample position (forward mode differentiation).
+// Running the iteration on them gives the gradient of the distance estimate in one pass
+
+struct Dual3 {
+    float v;
+    glm::vec3 d;
+};
+
+FRACTAL_FUNC Dual3 dualConstant(float v) { return { v, glm::vec3(0.0f) }; }
+FRACTAL_FUNC Dual3 operator+(Dual3 a, Dual3 b) { return { a.v + b.v, a.d + b.d }; }
+FRACTAL_FUNC Dual3 operator-(Dual3 a, Dual3 b) { return { a.v - b.v, a.d - b.d }; }
+FRACTAL_FUNC Dual3 operator*(Dual3 a, Dual3 b) { return { a.v * b.v, a.d * b.v + b.d * a.v }; }
+FRACTAL_FUNC Dual3 operator/(Dual3 a, Dual3 b) { float q = a.v / b.v; return { q, (a.d - b.d * q) / b.v }; }
+FRACTAL_FUNC Dual3 operator+(Dual3 a, float s) { return { a.v + s, a.d }; }
+FRACTAL_FUNC Dual3 operator*(Dual3 a, float s) { return { a.v * s, a.d * s }; }
+
+// f(a) where f(a.v) = value and f'(a.v) = slope
+FRACTAL_FUNC Dual3 dualChain(Dual3 a, float value, float slope) { return { value, a.d * slope }; }
+FRACTAL_FUNC Dual3 dualSqrt(Dual3 a) { float s = sqrtf(a.v); return dualChain(a, s, 0.5f / s); }
+FRACTAL_FUNC Dual3 dualLog(Dual3 a) { return dualChain(a, logf(a.v), 1.0f / a.v); }
+FRACTAL_FUNC Dual3 dualSin(Dual3 a) { return dualChain(a, sinf(a.v), cosf(a.v)); }
+FRACTAL_FUNC Dual3 dualCos(Dual3 a) { return dualChain(a, cosf(a.v), -sinf(a.v)); }
+// the slope is infinite at +-1 (on the z axis), it is clamped to stay finite
+FRACTAL_FUNC Dual3 dualAcos(Dual3 a) { return dualChain(a, acosf(a.v), -1.0f / sqrtf(glm::max(1.0f - a.v * a.v, 1e-12f))); }
+FRACTAL_FUNC Dual3 dualAtan2(Dual3 y, Dual3 x) { return { atan2f(y.v, x.v), (y.d * x.v - x.d * y.v) / (x.v * x.v + y.v * y.v) }; }
+// a^p for a > 0
+FRACTAL_FUNC Dual3 dualPow(Dual3 a, float p) { float powM1 = powf(a.v, p - 1.0f); return dualChain(a, powM1 * a.v, p * powM1); }
+
+FRACTAL_FUNC Dual3 dualIpow(Dual3 x, int n) {
+    Dual3 result = dualConstant(1.0f);
+    while (n > 0) {
+        if (n & 1) result = result * x;
+        x = x * x;
+        n >>= 1;
+    }
+    return result;
+}
+
+// (re + im i)^n
+FRACTAL_FUNC void dualComplexPow(Dual3& re, Dual3& im, int n) {
+    Dual3 resultRe = dualConstant(1.0f), resultIm = dualConstant(0.0f);
+    while (n > 0) {
+        if (n & 1) {
+            Dual3 t = resultRe * re - resultIm * im;
+            resultIm = resultRe * im + resultIm * re;
+            resultRe = t;
+        }
+        Dual3 t = re * re - im * im;
+        im = re * im * 2.0f;
+        re = t;
+        n >>= 1;
+    }
+    re = resultRe;
+    im = resultIm;
+}
+
+// Gradient of mandelbulb() with respect to pos. StaticPower / StaticIterations > 0 replace the runtime parameters
+template <int StaticPower, int StaticIterations>
+FRACTAL_FUNC glm::vec3 mandelbulbGradient(glm::vec3 pos, const glm::mat3& rotation, const FractalParams& params) {
+    // z0 = R pos, the partial derivatives of z0 are the rows of R
+    glm::vec3 z0 = rotation * pos;
+    Dual3 zx = { z0.x, glm::vec3(rotation[0].x, rotation[1].x, rotation[2].x) };
+    Dual3 zy = { z0.y, glm::vec3(rotation[0].y, rotation[1].y, rotation[2].y) };
+    Dual3 zz = { z0.z, glm::vec3(rotation[0].z, rotation[1].z, rotation[2].z) };
+    Dual3 cx = { pos.x, glm::vec3(1.0f, 0.0f, 0.0f) };
+    Dual3 cy = { pos.y, glm::vec3(0.0f, 1.0f, 0.0f) };
+    Dual3 cz = { pos.z, glm::vec3(0.0f, 0.0f, 1.0f) };
+
+    const float power = StaticPower > 0 ? (float)StaticPower : params.power;
+    const int iterations = StaticIterations > 0 ? StaticIterations : params.iterations;
+    bool triplex = StaticPower > 0 || (params.formula == FormulaMode::Triplex && power == floorf(power));
+
+    Dual3 derivative = dualConstant(1.0f);
+    Dual3 radius = dualConstant(0.0f);
+
+    for (int i = 0; i < iterations; i++) {
+
+        radius = dualSqrt(zx * zx + zy * zy + zz * zz);
+
+        if (radius.v > 2.0f) break;
+
+        if (triplex) {
+            const int n = StaticPower > 0 ? StaticPower : (int)power;
+            Dual3 rPowM1 = dualIpow(radius, n - 1);
+            derivative = rPowM1 * power * derivative + 1.0f;
+
+            Dual3 rho = dualSqrt(zx * zx + zy * zy);
+            Dual3 polarRe = zz / radius, polarIm = rho / radius;
+            dualComplexPow(polarRe, polarIm, n);
+            Dual3 azimuthRe = dualConstant(1.0f), azimuthIm = dualConstant(0.0f);
+            if (rho.v > 0.0f) {
+                azimuthRe = zx / rho;
+                azimuthIm = zy / rho;
+                dualComplexPow(azimuthRe, azimuthIm, n);
+            }
+
+            Dual3 zr = rPowM1 * radius;
+            zx = polarIm * azimuthRe * zr + cx;
+            zy = polarIm * azimuthIm * zr + cy;
+            zz = polarRe * zr + cz;
+            continue;
+        }
+
+        Dual3 theta = dualAcos(zz / radius) * power;
+        Dual3 phi = dualAtan2(zy, zx) * power;
+        derivative = dualPow(radius, power - 1.0f) * power * derivative + 1.0f;
+
+        Dual3 zr = dualPow(radius, power);
+        Dual3 sinTheta = dualSin(theta);
+        zx = sinTheta * dualCos(phi) * zr + cx;
+        zy = dualSin(phi) * sinTheta * zr + cy;
+        zz = dualCos(theta) * zr + cz;
+    }
+    Dual3 distance = dualLog(radius) * radius / derivative * 0.5f;
+    return distance.d;
+}
+
+// Distance estimators as function objects, the marching functions below are templated on them
+// so each estimator gets its own fully inlined march
+template <int Power, int Iterations>
+struct StaticMandelbulb {
+    FRACTAL_FUNC float operator()(glm::vec3 pos, const glm::mat3& rotation, int* iterationsDone = nullptr) const { return mandelbulb<Power, Iterations>(pos, rotation, iterationsDone); }
+    FRACTAL_FUNC glm::vec3 gradient(glm::vec3 pos, const glm::mat3& rotation) const { return mandelbulbGradient<Power, Iterations>(pos, rotation, FractalParams{}); }
+};
+
+struct DynamicMandelbulb {
+    FractalParams params;
+    FRACTAL_FUNC float operator()(glm::vec3 pos, const glm::mat3& rotation, int* iterationsDone = nullptr) const { return mandelbulb(pos, rotation, params, iterationsDone); }
+    FRACTAL_FUNC glm::vec3 gradient(glm::vec3 pos, const glm::mat3& rotation) const { return mandelbulbGradient<0, 0>(pos, rotation, params); }
+};
+
+template <int Power, int... Iterations, typename F>
+bool dispatchIterations(int iterations, F& f) {
+    return ((iterations == Iterations && (f(StaticMandelbulb<Power, Iterations>{}), true)) || ...);
+}
+
+template <int... Powers, typename F>
+bool dispatchPowers(int power, int iterations, F& f) {
+    return ((power == Powers && dispatchIterations<Powers, 8, 12, 16>(iterations, f)) || ...);
+}
+
+// Host side: calls f(de) once with the distance estimator for params: the functor of params.type from fractal/formulas.h,
+// StaticMandelbulb for the common triplex power / iteration combinations of the Mandelbulb and DynamicMandelbulb for
+// every other Mandelbulb. Returns whether an estimator specialized for the parameters was used.
+// Every combination listed here is instantiated for every caller, keep the list short
+template <typename F>
+bool dispatchDistanceEstimator(const FractalParams& params, F&& f) {
+    switch (params.type) {
+    case FractalType::Mandelbox: f(Mandelbox{ {}, params }); return false;
+    case FractalType::QuaternionJulia: f(QuaternionJulia{ {}, params }); return false;
+    case FractalType::MengerSponge: f(MengerSponge{ {}, params }); return false;
+    default: break;
+    }
+    bool integerPower = params.power == floorf(params.power);
+    if (params.formula == FormulaMode::Triplex && integerPower && dispatchPowers<3, 4, 8, 12>((int)params.power, params.iterations, f)) return true;
+    f(DynamicMandelbulb{ params });
+    return false;
+}
+
+// same with the estimator reading every parameter at runtime, for the wrappers that only pay off on the slow estimators
+// (CachedDistanceEstimator)
+template <typename F>
+void dispatchGenericEstimator(const FractalParams& params, F&& f) {
+    if (params.type == FractalType::Mandelbulb) f(DynamicMandelbulb{ params });
+    else dispatchDistanceEstimator(params, f);
+}
+
+inline bool isSpecialized(const FractalParams& params) {
+    return dispatchDistanceEstimator(params, [](auto) {});
+}
+
+template <typename DE>
+FRACTAL_FUNC glm::vec3 calculateNormal(glm::vec3 pos, const glm::mat3& rotation, const DE& de, NormalMode mode) {
+    if (mode == NormalMode::Analytic) return glm::normalize(de.gradient(pos, rotation));
+
+    float epsilon = 0.0005f;
+    float dx = de(glm::vec3(pos.x + epsilon, pos.y, pos.z), rotation) - de(glm::vec3(pos.x - epsilon, pos.y, pos.z), rotation);
+    float dy = de(glm::vec3(pos.x, pos.y + epsilon, pos.z), rotation) - de(glm::vec3(pos.x, pos.y - epsilon, pos.z), rotation);
+    float dz = de(glm::vec3(pos.x, pos.y, pos.z + epsilon), rotation) - de(glm::vec3(pos.x, pos.y, pos.z - epsilon), rotation);
+    return glm::normalize(glm::vec3(dx, dy, dz));
+}
+
+// Radius of a sphere around the origin containing every point the marcher can hit (0: no bound).
+// For the Mandelbulb:
+// With |z0| = |c| the orbit grows in every iteration once |c|^(power - 1) > 2, because |z^power + c| >= |z|^power - |c|,
+// and points beyond the escape radius 2 stop after the first iteration with an estimate of at least 0.69.
+// The margin keeps the distance estimate on the sphere well above the hit threshold
+inline float fractalBoundingRadius(const FractalParams& params) {
+    if (params.type != FractalType::Mandelbulb) return formulaBoundingRadius(params);
+    if (params.power <= 1.0f) return 0.0f;
+    return fminf(2.0f, powf(2.0f, 1.0f / (params.power - 1.0f))) + 0.1f;
+}
+
+// entry and exit distance of r through the sphere of the given radius around the origin, false if r misses it.
+// r.direction is normalized
+FRACTAL_FUNC bool intersectBoundingSphere(ray r, float radius, float* tNear, float* tFar) {
+    float b = glm::dot(r.origin, r.direction);
+    float c = glm::dot(r.origin, r.origin) - radius * radius;
+    float discriminant = b * b - c;
+    if (discriminant < 0.0f) return false;
+    float root = sqrtf(discriminant);
+    *tNear = -b - root;
+    *tFar = -b + root;
+    return *tFar >= 0.0f;
+}
+
+// Fraction of maxRaySteps added to the step budget per doubling of the zoom with FractalParams::adaptiveSteps.
+// The hit threshold halves with every doubling and the rays graze ever finer detail on their way to it:
+// with 50 steps at zoom 512 only 8% of the rays reach the surface (cone prepass on), 93% with this budget (162 steps)
+constexpr float cStepsPerZoomOctave = 0.25f;
+// lower bound of FrameConstants::footprintSlope, single precision positions are no finer than ~1e-7 around the fractal
+constexpr float cMinFootprintSlope = 1e-6f;
+
+// Host side: sets frame.footprintSlope and the step budget frame.fractal.maxRaySteps from the camera and the size of frame
+inline void adaptToPixelFootprint(FrameConstants& frame)
+{
+    // rayTransform maps (u, v, 1) to the direction of a ray and u advances 1 / min(width, height) per pixel,
+    // the angle between two pixels at the image centre is about that over the length of the centre direction
+    float zoom = glm::length(glm::vec3(frame.rayTransform[2])) / glm::length(glm::vec3(frame.rayTransform[0]));
+    float pixelAngle = 1.0f / (zoom * (float)glm::min(frame.width, frame.height));
+    frame.footprintSlope = frame.fractal.footprintEpsilon > 0.0f ? fmaxf(frame.fractal.footprintEpsilon * pixelAngle, cMinFootprintSlope) : 0.0f;
+    if (frame.fractal.adaptiveSteps && zoom > 1.0f) frame.fractal.maxRaySteps += (int)(frame.fractal.maxRaySteps * cStepsPerZoomOctave * log2f(zoom));
+}
+
+// distance estimate below which a ray that travelled t hits the surface
+FRACTAL_FUNC float hitThreshold(float t, const FrameConstants& frame)
+{
+    return frame.footprintSlope > 0.0f ? t * frame.footprintSlope : frame.fractal.minDistance;
+}
+
+// start_dist: distance along the ray known to be free of surface, e.g. from coneMarch.
+// With fractal.overRelaxation > 1 the ray advances by that multiple of the estimate (Keinert et al., "Enhanced Sphere
+// Tracing"). The unbounding spheres of two consecutive points overlapping proves the segment between them empty; once
+// they do not the ray steps back to the end of the previous sphere and continues with plain sphere tracing.
+// evaluations (optional) receives the number of distance estimates
+template <typename DE>
+FRACTAL_FUNC float march(ray r, const FrameConstants& frame, const DE& de, float start_dist, glm::vec3* hitPos, int* evaluations = nullptr) {
+    float total_dist = start_dist;
+    float max_dist = FLT_MAX;
+    int max_ray_steps = frame.fractal.maxRaySteps;
+    if (evaluations) *evaluations = 0;
+
+    // rays missing the bounding sphere are background without a single estimate, the others start where they enter it
+    if (frame.boundingRadius > 0.0f) {
+        float tNear, tFar;
+        if (!intersectBoundingSphere(r, frame.boundingRadius, &tNear, &tFar)) return 0.0f;
+        total_dist = glm::max(tNear, start_dist);
+        max_dist = tFar;
+    }
+
+    float omega = frame.fractal.overRelaxation;
+    float previous = 0.0f, step = 0.0f; // estimate at the previous point and the step taken from it
+    int steps;
+    for (steps = 0; steps < max_ray_steps; ++steps) {
+        glm::vec3 p = r.origin + r.direction * total_dist;
+        float distance = de(p, frame.objectRotation);
+        if (evaluations) ++*evaluations;
+        if (omega > 1.0f && distance + previous < step) {
+            total_dist -= step - previous;
+            omega = 1.0f;
+            continue;
+        }
+        if (distance < hitThreshold(total_dist, frame)) {
+            *hitPos = p;
+            break;
+        }
+        if (total_dist + distance > max_dist) {
+            steps = max_ray_steps; // left the sphere, it would never hit
+            break;
+        }
+        previous = distance;
+        step = distance * omega;
+        total_dist += step;
+    }
+    return 1.0f - (float)steps / (float)max_ray_steps;
+}
+
+// ray through image position (x, y) in pixels of a frame.width x frame.height image
+FRACTAL_FUNC ray get_image_ray(float x, float y, const FrameConstants& frame)
+{
+    float min_w_h = (float)glm::min(frame.width, frame.height);
+
+    float ar = (float)frame.width / (float)frame.height;
+    float u = x / min_w_h - ar * 0.5f;
+    float v = y / min_w_h - 0.5f;
+
+    return get_ray(u, v, frame.rayTransform);
+}
+
+// primary ray of pixel (x, y)
+FRACTAL_FUNC ray get_pixel_ray(unsigned int x, unsigned int y, const FrameConstants& frame)
+{
+    return get_image_ray((float)x, (float)y, frame);
+}
+
+// edge length in pixels of the tiles of the cone prepass
+constexpr unsigned int cConeTileSize = 8;
+
+// Cone around the primary rays of every pixel of cone tile (tileX, tileY): returns the axis, *tanHalfAngle the opening
+FRACTAL_FUNC ray coneAxis(unsigned int tileX, unsigned int tileY, const FrameConstants& frame, float* tanHalfAngle)
+{
+    float x0 = (float)(tileX * cConeTileSize), y0 = (float)(tileY * cConeTileSize);
+    float x1 = (float)glm::min((tileX + 1) * cConeTileSize, frame.width) - 1.0f;
+    float y1 = (float)glm::min((tileY + 1) * cConeTileSize, frame.height) - 1.0f;
+    ray axis = get_image_ray(0.5f * (x0 + x1), 0.5f * (y0 + y1), frame);
+
+    // the pixel rays span a convex patch of the image plane, the widest angle is at one of its corners.
+    // The patch reaches half a pixel beyond the outer pixel centres for the jittered samples of the progressive refinement
+    x0 -= 0.5f;
+    y0 -= 0.5f;
+    x1 += 0.5f;
+    y1 += 0.5f;
+    float cosHalfAngle = 1.0f;
+    cosHalfAngle = glm::min(cosHalfAngle, glm::dot(axis.direction, get_image_ray(x0, y0, frame).direction));
+    cosHalfAngle = glm::min(cosHalfAngle, glm::dot(axis.direction, get_image_ray(x1, y0, frame).direction));
+    cosHalfAngle = glm::min(cosHalfAngle, glm::dot(axis.direction, get_image_ray(x0, y1, frame).direction));
+    cosHalfAngle = glm::min(cosHalfAngle, glm::dot(axis.direction, get_image_ray(x1, y1, frame).direction));
+    *tanHalfAngle = sqrtf(glm::max(1.0f - cosHalfAngle * cosHalfAngle, 0.0f)) / cosHalfAngle;
+    return axis;
+}
+
+// Marches the cone of a cone tile and returns a distance every pixel ray of the tile can skip.
+// While the empty sphere of radius d around the axis point at t covers the cone, advancing by
+// (d - t tan) / (1 + tan) keeps the whole cone segment inside it.
+// Pixel rays starting there take different samples than rays starting at the camera, so a few pixels on thin
+// features flip between hit and miss (~0.02% in either direction, mostly they hit now because fewer run out of steps)
+template <typename DE>
+FRACTAL_FUNC float coneMarch(unsigned int tileX, unsigned int tileY, const FrameConstants& frame, const DE& de)
+{
+    float tanHalfAngle;
+    ray axis = coneAxis(tileX, tileY, frame, &tanHalfAngle);
+
+    float t = 0.0f, max_dist = FLT_MAX;
+    if (frame.boundingRadius > 0.0f) {
+        float tNear, tFar;
+        if (intersectBoundingSphere(axis, frame.boundingRadius, &tNear, &tFar)) max_dist = tFar;
+    }
+
+    for (int steps = 0; steps < frame.fractal.maxRaySteps && t < max_dist; ++steps) {
+        float distance = de(axis.origin + axis.direction * t, frame.objectRotation);
+        float advance = (distance - t * tanHalfAngle) / (1.0f + tanHalfAngle);
+        if (advance < hitThreshold(t, frame)) break; // the cone touches the surface
+        t += advance;
+    }
+    return t;
+}
+
+// maps the value returned by march() (and the normal at the hit position when normal_surface is set) to the output colour
+FRACTAL_FUNC glm::vec4 colorPixel(float c, glm::vec3 normal, bool normal_surface)
+{
+    glm::vec4 dataOut = glm::vec4(c * 0.5f, c * 0.5f, c * 1.0f, 1.0f);
+
+    if (normal_surface) {
+        normal = normal * 0.5f + glm::vec3(0.4f, 0.4f, 0.4f);
+        dataOut = glm::vec4(normal.x, normal.y, normal.z, 1.0f);
+    }
+
+    return dataOut;
+}
+
+// Temporal reprojection: rays start this fraction short of the distance reprojected from the previous frame.
+// Most estimates of a hitting ray are spent close to the surface (~20 of 22 steps are still left at 0.9 t), so the margin has to be small
+constexpr float cReprojectionMargin = 0.003f;
+// the old distances around a ray may differ by this fraction at most, else the ray starts at the safe start. Larger
+// spreads trust more creases and silhouettes (0.05 flipped 6 to 170 times the pixels of 0.005), smaller ones reject flat surfaces
+// at grazing angles (0.001 lost most of the gain)
+constexpr float cReprojectionSpread = 0.005f;
+
+// Start distance for the ray with direction dir from the hit distances of the previous frame (history, 0 for misses).
+// Renderer only changes zoom and offset of the camera, never its position, so every ray of this frame is a ray of
+// the previous frame as well and its old hit distance can be looked up without knowing the depth. The ray lies between
+// the 2x2 shaded old rays around it (frame.historyStep apart). Only if they hit the same surface, their distances within
+// cReprojectionSpread of each other, is the surface taken to continue between them. A miss among them, a silhouette or
+// a crease, and rays leaving the old image give 0, which skips nothing.
+// A feature in front of the start that none of the old rays hit is still skipped. 640x480 zoom and pan sequences with
+// normals marched 19-25% faster on the AVX-512 packets (22-34% scalar) and flipped hit/miss on 0.0004-0.003% of the
+// pixels, all of them hits where the march from the safe start stepped past the surface, and about one hit per frame
+// moved behind a skipped feature. So the Renderer leaves it off by default
+FRACTAL_FUNC float reprojectStart(glm::vec3 dir, const FrameConstants& frame, const float* history)
+{
+    glm::vec3 q = frame.previousInverseRay * dir; // (u, v, 1) on the previous image plane times a positive scale
+    if (q.z <= 0.0f) return 0.0f;
+
+    float min_w_h = (float)glm::min(frame.width, frame.height);
+    float ar = (float)frame.width / (float)frame.height;
+    float invZ = 1.0f / q.z;
+    float px = (q.x * invZ + ar * 0.5f) * min_w_h;
+    float py = (q.y * invZ + 0.5f) * min_w_h;
+    if (!(px >= 0.0f && py >= 0.0f && px < (float)frame.width && py < (float)frame.height)) return 0.0f;
+    int step = (int)frame.historyStep;
+    int x = (int)px / step * step, y = (int)py / step * step; // the shaded old pixel left of and above the ray
+    if (x + step >= (int)frame.width || y + step >= (int)frame.height) return 0.0f;
+
+    const float* row = history + y * (int)frame.width + x;
+    const float* below = row + step * (int)frame.width;
+    float nearest = glm::min(glm::min(row[0], row[step]), glm::min(below[0], below[step]));
+    float farthest = glm::max(glm::max(row[0], row[step]), glm::max(below[0], below[step]));
+    if (farthest > nearest * (1.0f + cReprojectionSpread)) return 0.0f;
+    return nearest * (1.0f - cReprojectionMargin);
+}
+
+// A march from a reprojected start (reprojectStart) is only trusted if it hit the surface after at least one step and
+// no farther than the old rays around it did. Missing or hitting farther means the ray went past the surface they saw,
+// hitting on the first estimate means the start already was inside the surface; all are marched again from the safe start
+FRACTAL_FUNC bool reprojectionFailed(float c, float start, float hitDistance)
+{
+    constexpr float reach = (1.0f + 2.0f * cReprojectionSpread) / (1.0f - cReprojectionMargin);
+    return c <= 0.0f || c >= 1.0f || hitDistance > start * reach;
+}
+
+// Shades the image position (x, y) in pixels of the frame. Both backends call this so their output matches.
+// start_dist is the safe start (cone prepass), history the hit distances of the previous frame or nullptr.
+// hitDistance receives the distance of the hit from the camera for the next frame's history, 0 for misses.
+// evaluations receives the distance estimates of the marches
+template <typename DE>
+FRACTAL_FUNC glm::vec4 shadeSample(float x, float y, const FrameConstants& frame, const DE& de, float start_dist = 0.0f,
+    const float* history = nullptr, float* hitDistance = nullptr, int* evaluations = nullptr)
+{
+    ray r = get_image_ray(x, y, frame);
+    float reprojected = history ? reprojectStart(r.direction, frame, history) : 0.0f;
+
+    glm::vec3 hitPos = r.origin; // rays that never hit keep a defined position
+    float c = march(r, frame, de, glm::max(start_dist, reprojected), &hitPos, evaluations);
+    if (reprojected > start_dist && reprojectionFailed(c, reprojected, glm::length(hitPos - r.origin))) {
+        int retryEvaluations = 0;
+        hitPos = r.origin;
+        c = march(r, frame, de, start_dist, &hitPos, &retryEvaluations);
+        if (evaluations) *evaluations += retryEvaluations;
+    }
+    if (hitDistance) *hitDistance = c > 0.0f ? glm::length(hitPos - r.origin) : 0.0f;
+
+    glm::vec3 normal = frame.normalSurface ? calculateNormal(hitPos, frame.objectRotation, de, frame.fractal.normalMode) : glm::vec3(0.0f);
+    return colorPixel(c, normal, frame.normalSurface);
+}
+
+// shadeSample at the centre of pixel (x, y)
+template <typename DE>
+FRACTAL_FUNC glm::vec4 shadePixel(unsigned int x, unsigned int y, const FrameConstants& frame, const DE& de, float start_dist = 0.0f,
+    const float* history = nullptr, float* hitDistance = nullptr)
+{
+    return shadeSample((float)x, (float)y, frame, de, start_dist, history, hitDistance);
+}
+
+// Progressive refinement (frame.progressive): pass 0 shades one pixel of every 2x2 block and fills the block with it,
+// passes 1 to 3 shade the other pixels of the blocks, every later pass adds one jittered sample to every pixel,
+// averaged in a float accumulation image. The Renderer restarts at pass 0 whenever the image changes
+constexpr unsigned int cRefinementSubsets = 4;
+
+// pixel of the 2x2 block shaded by pass < cRefinementSubsets, diagonal first so pass 1 already halves the blockiness
+FRACTAL_FUNC glm::uvec2 refinementOffset(unsigned int pass)
+{
+    return glm::uvec2((0x6u >> pass) & 1u, (0xau >> pass) & 1u); // (0, 0), (1, 1), (1, 0), (0, 1)
+}
+
+// sub pixel offset of the sample of pass >= cRefinementSubsets, an R2 sequence. Within half a pixel, like the cones
+FRACTAL_FUNC glm::vec2 refinementJitter(unsigned int pass)
+{
+    float i = (float)(pass - cRefinementSubsets + 1);
+    glm::vec2 r2 = glm::fract(glm::vec2(0.5f) + i * glm::vec2(0.75487766f, 0.56984029f));
+    return r2 - 0.5f;
+}
+
+// running mean of the samples of a pixel: pass >= cRefinementSubsets adds its sample to the pass - 2 before it
+FRACTAL_FUNC glm::vec4 accumulateSample(glm::vec4 mean, glm::vec4 sample, unsigned int pass)
+{
+    return mean + (sample - mean) / (float)(pass - cRefinementSubsets + 2);
+}
+
+#endif//FRACTAL_MANDELBULB_H
@@ -0,0 +1,123 @@
+#ifndef FRACTAL_PIXEL_COUNTERS_H
+#define FRACTAL_PIXEL_COUNTERS_H
+#include "fractal/mandelbulb.h"
+#include "fractal/deep_zoom.h"
+#include <type_traits>
+
+// Per pixel instrumentation (FrameConstants::instrumentation).
+// The backends shade the pixels of an instrumented frame through InstrumentedEstimator, a wrapper of the distance
+// estimator that counts into the PixelCounters of the pixel; the march and the normal are the same code as always.
+// The cone prepass is shared by the pixels of a cone tile and not counted
+
+struct PixelCounters {
+    // distance estimates of the march, the second march of a failed reprojection included
+    uint32_t marchSteps;
+    // fractal iterations of every estimate of the pixel, normal included. Brick map lookups take none
+    uint32_t deIterations;
+    // iterations of the last march estimate before the orbit escaped, FractalParams::iterations if it never did
+    uint32_t escapeIteration;
+    // distance estimates taken for the normal, an analytic gradient counts as one
+    uint32_t normalTaps;
+};
+
+FRACTAL_FUNC uint32_t pixelCounterValue(const PixelCounters& counters, PixelCounter counter)
+{
+    switch (counter) {
+    case PixelCounter::MarchSteps: return counters.marchSteps;
+    case PixelCounter::DEIterations: return counters.deIterations;
+    case PixelCounter::EscapeIteration: return counters.escapeIteration;
+    default: return counters.normalTaps;
+    }
+}
+
+// distance estimates of one gradient() call, the deep zoom path and the formulas of fractal/formulas.h differentiate numerically
+template <typename DE>
+inline constexpr int cGradientTaps = std::is_base_of_v<NumericalGradient<DE>, DE> ? 6 : 1;
+template <>
+inline constexpr int cGradientTaps<PerturbedMandelbulb> = 6;
+
+// counts the estimates of the march
+template <typename DE>
+struct InstrumentedEstimator {
+    DE de;
+    PixelCounters* counters;
+
+    FRACTAL_FUNC float operator()(glm::vec3 pos, const glm::mat3& rotation, int* iterationsDone = nullptr) const {
+        int iterations;
+        float distance = de(pos, rotation, &iterations);
+        ++counters->marchSteps;
+        counters->deIterations += (uint32_t)iterations;
+        counters->escapeIteration = (uint32_t)iterations;
+        if (iterationsDone) *iterationsDone = iterations;
+        return distance;
+    }
+};
+
+// counts the estimates of the normal
+template <typename DE>
+struct NormalTapCounter {
+    DE de;
+    PixelCounters* counters;
+
+    FRACTAL_FUNC float operator()(glm::vec3 pos, const glm::mat3& rotation, int* iterationsDone = nullptr) const {
+        int iterations;
+        float distance = de(pos, rotation, &iterations);
+        ++counters->normalTaps;
+        counters->deIterations += (uint32_t)iterations;
+        if (iterationsDone) *iterationsDone = iterations;
+        return distance;
+    }
+    // the gradient iterates the orbit of the hit position, which escaped at the last march estimate
+    FRACTAL_FUNC glm::vec3 gradient(glm::vec3 pos, const glm::mat3& rotation) const {
+        counters->normalTaps += cGradientTaps<DE>;
+        counters->deIterations += cGradientTaps<DE> * counters->escapeIteration;
+        return de.gradient(pos, rotation);
+    }
+};
+
+// picked by overload resolution in shadeSample, the march is over once the normal is taken
+template <typename DE>
+FRACTAL_FUNC glm::vec3 calculateNormal(glm::vec3 pos, const glm::mat3& rotation, const InstrumentedEstimator<DE>& de, NormalMode mode)
+{
+    return calculateNormal(pos, rotation, NormalTapCounter<DE>{ de.de, de.counters }, mode);
+}
+
+// the deep zoom path for the instrumented PerturbedMandelbulb, see shadeSample in fractal/deep_zoom.h
+FRACTAL_FUNC glm::vec4 shadeSample(float x, float y, const FrameConstants& frame, const InstrumentedEstimator<PerturbedMandelbulb>& de,
+    float /*start_dist*/ = 0.0f, const float* /*history*/ = nullptr, float* hitDistance = nullptr, int* evaluations = nullptr)
+{
+    return shadePerturbedSample(x, y, frame, de, hitDistance, evaluations);
+}
+
+// shadeSample with the counters of the sample written to counters
+template <typename DE>
+FRACTAL_FUNC glm::vec4 shadeInstrumentedSample(float x, float y, const FrameConstants& frame, const DE& de, PixelCounters* counters,
+    float start_dist = 0.0f, const float* history = nullptr, float* hitDistance = nullptr, int* evaluations = nullptr)
+{
+    *counters = {};
+    return shadeSample(x, y, frame, InstrumentedEstimator<DE>{ de, counters }, start_dist, history, hitDistance, evaluations);
+}
+
+// upper end of the heatmap of counter without FrameConstants::heatmapMax: the step budget, the iteration count, 6 taps
+// of the central differences and the iterations of a ray that spends its whole budget next to the surface
+FRACTAL_FUNC float naturalCounterMax(PixelCounter counter, const FrameConstants& frame)
+{
+    switch (counter) {
+    case PixelCounter::MarchSteps: return (float)frame.fractal.maxRaySteps;
+    case PixelCounter::DEIterations: return (float)(frame.fractal.maxRaySteps * frame.fractal.iterations);
+    case PixelCounter::EscapeIteration: return (float)frame.fractal.iterations;
+    default: return 6.0f;
+    }
+}
+
+// colour of the heatmap for the counters of a pixel shaded as color: blue, cyan, green, yellow, red from 0 to the
+// maximum, over a dimmed copy of the shading so the shape stays visible
+FRACTAL_FUNC glm::vec4 heatmapColor(const PixelCounters& counters, const FrameConstants& frame, glm::vec4 color)
+{
+    float maximum = frame.heatmapMax > 0.0f ? frame.heatmapMax : naturalCounterMax(frame.heatmapCounter, frame);
+    float t = glm::clamp((float)pixelCounterValue(counters, frame.heatmapCounter) / glm::max(maximum, 1.0f), 0.0f, 1.0f);
+    glm::vec3 heat = glm::clamp(glm::vec3(4.0f * t - 2.0f, t < 0.5f ? 4.0f * t : 4.0f - 4.0f * t, 2.0f - 4.0f * t), glm::vec3(0.0f), glm::vec3(1.0f));
+    return glm::vec4(heat * 0.8f + glm::vec3(color) * 0.2f, 1.0f);
+}
+
+#endif//FRACTAL_PIXEL_COUNTERS_H
@@ -0,0 +1,175 @@
+#include "rendering/animation_renderer.h"
+#include <tinygltf/stb_image_write.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+template <typename T>
+static T catmullRom(T p0, T p1, T p2, T p3, float t)
+{
+    return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * (t * t) + (3.0f * p1 - p0 - 3.0f * p2 + p3) * (t * t * t));
+}
+
+AnimationKey sampleTimeline(const std::vector<AnimationKey>& keys, double time)
+{
+    if (keys.empty()) return {};
+    if (time <= keys.front().time) return keys.front();
+    if (time >= keys.back().time) return keys.back();
+
+    size_t i = 0;
+    while (keys[i + 1].time < time) ++i;
+    const AnimationKey& k0 = keys[i == 0 ? 0 : i - 1];
+    const AnimationKey& k1 = keys[i];
+    const AnimationKey& k2 = keys[i + 1];
+    const AnimationKey& k3 = keys[std::min(i + 2, keys.size() - 1)];
+    double span = k2.time - k1.time;
+    float t = span > 0.0 ? (float)((time - k1.time) / span) : 1.0f;
+
+    AnimationKey key;
+    key.time = time;
+    // double for the camera, deep zooms resolve offsets far below float precision
+    key.zoom = std::exp(catmullRom(std::log(k0.zoom), std::log(k1.zoom), std::log(k2.zoom), std::log(k3.zoom), t));
+    key.offsetX = catmullRom(k0.offsetX, k1.offsetX, k2.offsetX, k3.offsetX, t);
+    key.offsetY = catmullRom(k0.offsetY, k1.offsetY, k2.offsetY, k3.offsetY, t);
+    key.theta = catmullRom(k0.theta, k1.theta, k2.theta, k3.theta, t);
+    key.power = catmullRom(k0.power, k1.power, k2.power, k3.power, t);
+    return key;
+}
+
+bool saveTimeline(const std::filesystem::path& path, const std::vector<AnimationKey>& keys)
+{
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+    file.precision(17);
+    file << "# time zoom offsetX offsetY thetaX thetaY thetaZ power\n";
+    for (auto& k : keys) {
+        file << k.time << ' ' << k.zoom << ' ' << k.offsetX << ' ' << k.offsetY << ' '
+             << k.theta.x << ' ' << k.theta.y << ' ' << k.theta.z << ' ' << k.power << '\n';
+    }
+    return file.good();
+}
+
+bool loadTimeline(const std::filesystem::path& path, std::vector<AnimationKey>& keys)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+    std::vector<AnimationKey> loaded;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream in(line);
+        AnimationKey k;
+        if (in >> k.time >> k.zoom >> k.offsetX >> k.offsetY >> k.theta.x >> k.theta.y >> k.theta.z >> k.power) loaded.push_back(k);
+    }
+    if (loaded.empty()) return false;
+    std::stable_sort(loaded.begin(), loaded.end(), [](const AnimationKey& a, const AnimationKey& b) { return a.time < b.time; });
+    keys = std::move(loaded);
+    return true;
+}
+
+bool AnimationRenderer::start(const std::filesystem::path& directory, const std::vector<AnimationKey>& keys, const AnimationSettings& settings)
+{
+    finish();
+    if (keys.size() < 2 || settings.framesPerSecond <= 0.0f) return false;
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error || !saveTimeline(directory / "timeline.txt", keys)) return false;
+
+    this->directory = directory;
+    this->keys = keys;
+    this->settings = settings;
+    frames = (uint32_t)((keys.back().time - keys.front().time) * settings.framesPerSecond) + 1;
+    nextFrame = 0;
+    written = 0;
+    renderTime = 0.0;
+    encodeTime = 0.0;
+    writeTime = 0.0;
+    failed = false;
+    rendered.reset();
+    encoded.reset();
+    encoder = std::thread(&AnimationRenderer::encoderLoop, this);
+    writer = std::thread(&AnimationRenderer::writerLoop, this);
+    running = true;
+    return true;
+}
+
+bool AnimationRenderer::renderNextFrame(const AnimationFrameFunction& buildFrame, const TileRenderFunction& renderFrame)
+{
+    if (!running || nextFrame == frames) return false;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    AnimationKey view = sampleTimeline(keys, keys.front().time + nextFrame / (double)settings.framesPerSecond);
+    FrameConstants frame = buildFrame(view, settings.width, settings.height);
+
+    QueuedFrame queued;
+    queued.index = nextFrame++;
+    {
+        std::lock_guard lock(mutex);
+        if (!freeBuffers.empty()) {
+            queued.pixels = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+    }
+    queued.pixels.resize((size_t)frame.width * frame.height);
+    renderSamples(frame, settings.samples, renderFrame, queued.pixels.data());
+    renderTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // blocks while the encoder is cMaxQueuedFrames behind
+    rendered.push(std::move(queued));
+    return true;
+}
+
+void AnimationRenderer::encoderLoop()
+{
+    QueuedFrame frame;
+    while (rendered.pop(frame)) {
+        auto start = std::chrono::high_resolution_clock::now();
+        frame.png.clear();
+        int ok = stbi_write_png_to_func([](void* context, void* data, int size) {
+            auto* png = static_cast<std::vector<uint8_t>*>(context);
+            png->insert(png->end(), static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + size);
+        }, &frame.png, settings.width, settings.height, 4, frame.pixels.data(), settings.width * sizeof(uint32_t));
+        encodeTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        {
+            std::lock_guard lock(mutex);
+            failed = failed || !ok;
+            freeBuffers.push_back(std::move(frame.pixels));
+        }
+        if (ok) encoded.push(std::move(frame));
+    }
+    encoded.close();
+}
+
+void AnimationRenderer::writerLoop()
+{
+    QueuedFrame frame;
+    while (encoded.pop(frame)) {
+        auto start = std::chrono::high_resolution_clock::now();
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%05u.png", frame.index);
+        std::ofstream file(directory / name, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(frame.png.data()), frame.png.size());
+        file.close();
+        bool ok = !file.fail();
+        writeTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        if (ok) ++written;
+        std::lock_guard lock(mutex);
+        failed = failed || !ok;
+    }
+}
+
+bool AnimationRenderer::finish()
+{
+    if (!running) return !failed;
+    // the encoder closes the second queue once it has drained the first
+    rendered.close();
+    encoder.join();
+    writer.join();
+    running = false;
+    freeBuffers.clear();
+    return !failed;
+}
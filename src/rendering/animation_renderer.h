@@ -0,0 +1,104 @@
+#ifndef ANIMATION_RENDERER_H
+#define ANIMATION_RENDERER_H
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "fractal/frame_constants.h"
+#include "rendering/tiled_renderer.h"
+#include "utility/bounded_queue.h"
+
+// Batch render of keyframed flythroughs into a numbered PNG sequence.
+// A timeline of keys (camera zoom and offset, object rotation, power) is sampled at a fixed frame rate and the frames
+// pass through three stages joined by bounded queues: the caller renders frame N + 1 on the backend while an encoder
+// thread compresses frame N to PNG and a writer thread puts frame N - 1 on disk. The render stage keeps the cores of
+// the backend busy, the other two hide behind it; a stage that falls behind blocks the ones before it once its queue
+// is full, so memory stays at a few frames
+
+// state of the view at one point of the timeline
+struct AnimationKey {
+    double time = 0.0; // seconds
+    double zoom = 1.0;
+    double offsetX = 0.0, offsetY = 0.0;
+    glm::vec3 theta = glm::vec3(0.0f); // angles of objectRotation
+    float power = 8.0f;
+};
+
+// view at time on keys (sorted by time): a Catmull-Rom spline through the keys, the zoom in log space so it zooms at
+// a steady speed. Holds the first and last key outside the timeline
+AnimationKey sampleTimeline(const std::vector<AnimationKey>& keys, double time);
+// text file, one key per line in the member order of AnimationKey, # starts a comment
+bool saveTimeline(const std::filesystem::path& path, const std::vector<AnimationKey>& keys);
+// false if path could not be read or holds no key, keys are sorted by time
+bool loadTimeline(const std::filesystem::path& path, std::vector<AnimationKey>& keys);
+
+struct AnimationSettings {
+    // of the frames, must not exceed the image the backend renders into
+    uint32_t width = 1280, height = 720;
+    float framesPerSecond = 30.0f;
+    // samples per pixel, see TiledRenderSettings::samples
+    int samples = 4;
+};
+
+// builds the frame of a view at width x height
+using AnimationFrameFunction = std::function<FrameConstants(const AnimationKey& view, uint32_t width, uint32_t height)>;
+
+class AnimationRenderer {
+public:
+    // frames rendered ahead of the encoder and encoded ahead of the writer
+    static constexpr size_t cMaxQueuedFrames = 2;
+
+    ~AnimationRenderer() { finish(); }
+
+    // renders keys into directory/frame_00000.png... and saves them to directory/timeline.txt. false if the directory
+    // could not be created or the timeline has less than two keys
+    bool start(const std::filesystem::path& directory, const std::vector<AnimationKey>& keys, const AnimationSettings& settings);
+    // renders the next frame through buildFrame and renderFrame (one call per refinement pass like the tiles of the
+    // TiledRenderer) and queues it for the encoder. false once every frame is rendered
+    bool renderNextFrame(const AnimationFrameFunction& buildFrame, const TileRenderFunction& renderFrame);
+    // waits for the frames in the pipeline, false if one could not be encoded or written
+    bool finish();
+
+    bool active() const { return running; }
+    const std::filesystem::path& path() const { return directory; }
+    uint32_t frameWidth() const { return settings.width; }
+    uint32_t frameHeight() const { return settings.height; }
+    uint32_t frameCount() const { return frames; }
+    uint32_t framesRendered() const { return nextFrame; }
+    uint32_t framesWritten() const { return written; }
+    // busy time of every stage so far, the slowest one sets the pace
+    double renderMilliseconds() const { return renderTime; }
+    double encodeMilliseconds() const { return encodeTime; }
+    double writeMilliseconds() const { return writeTime; }
+
+private:
+    struct QueuedFrame {
+        uint32_t index;
+        std::vector<uint32_t> pixels; // R8G8B8A8 texels from the render stage
+        std::vector<uint8_t> png; // the file from the encoder
+    };
+
+    void encoderLoop();
+    void writerLoop();
+
+    std::filesystem::path directory;
+    std::vector<AnimationKey> keys;
+    AnimationSettings settings;
+    uint32_t frames = 0;
+    uint32_t nextFrame = 0;
+    bool running = false;
+    double renderTime = 0.0;
+    std::atomic<double> encodeTime = 0.0, writeTime = 0.0;
+    std::atomic<uint32_t> written = 0;
+
+    std::thread encoder, writer;
+    BoundedQueue<QueuedFrame> rendered{ cMaxQueuedFrames }, encoded{ cMaxQueuedFrames };
+    std::mutex mutex; // of the members below
+    std::vector<std::vector<uint32_t>> freeBuffers; // pixels of encoded frames, reused
+    bool failed = false;
+};
+
+#endif//ANIMATION_RENDERER_H
@@ -0,0 +1,48 @@
+#ifndef VULKAN_INTRO_DYNAMIC_RESOLUTION_H
+#define VULKAN_INTRO_DYNAMIC_RESOLUTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Chooses the fraction of the render target the backends fill, from their measured render time.
+// The frame is rendered into the top left scale * extent corner of the image and copy.frag stretches it over the screen.
+// The render time is about proportional to the pixel count, so the time of one frame at scale 1 is estimated
+// as milliseconds / scale^2 and the scale for the target follows from that.
+class DynamicResolution {
+public:
+    bool enabled = false;
+    float targetMilliseconds = 16.0f;
+    float minScale = 0.25f;
+
+    // milliseconds: render time of a finished frame that was rendered with scale usedScale, <= 0 if there is none
+    void update(double milliseconds, float usedScale) {
+        if (!enabled) {
+            currentScale = 1.0f;
+            fullScaleMilliseconds = 0.0;
+            return;
+        }
+        if (milliseconds <= 0.0) return;
+
+        // smoothed, a single slow frame (e.g. a shader recompile) should not halve the resolution
+        double estimate = milliseconds / ((double)usedScale * usedScale);
+        fullScaleMilliseconds = fullScaleMilliseconds > 0.0 ? fullScaleMilliseconds + cSmoothing * (estimate - fullScaleMilliseconds) : estimate;
+
+        float wanted = std::clamp((float)std::sqrt(targetMilliseconds / fullScaleMilliseconds), minScale, 1.0f);
+        // small differences are noise, following them would change the resolution every frame
+        if (std::abs(wanted - currentScale) > cHysteresis * currentScale || wanted == 1.0f || wanted == minScale) currentScale = wanted;
+    }
+
+    float scale() const { return currentScale; }
+    // extent of the rendered part of an image with the given extent
+    uint32_t scaled(uint32_t extent) const { return std::max(1u, (uint32_t)std::lround(extent * currentScale)); }
+
+private:
+    static constexpr double cSmoothing = 0.2;
+    static constexpr float cHysteresis = 0.03f;
+
+    float currentScale = 1.0f;
+    double fullScaleMilliseconds = 0.0; // estimated render time at scale 1
+};
+
+#endif//VULKAN_INTRO_DYNAMIC_RESOLUTION_H
@@ -0,0 +1,68 @@
+#include "rendering/kernel_variant_cache.h"
+#include "fractal/mandelbulb.h"
+#include <chrono>
+#include <typeinfo>
+
+uint64_t kernelVariantKey(const FractalParams& params)
+{
+    uint64_t key = 0;
+    dispatchDistanceEstimator(params, [&key](auto de) { key = typeid(de).hash_code(); });
+    return key;
+}
+
+void KernelVariantCache::start(KernelVariantLoader loader)
+{
+    stop();
+    this->loader = std::move(loader);
+    queue.reset();
+    builder = std::thread(&KernelVariantCache::builderLoop, this);
+}
+
+void KernelVariantCache::stop()
+{
+    if (!builder.joinable()) return;
+    queue.close();
+    builder.join();
+    // the dropped variants are queued again by the next ready
+    std::lock_guard lock(mutex);
+    std::erase_if(states, [](const auto& it) { return it.second == State::Queued; });
+}
+
+void KernelVariantCache::prepare(const FractalParams& params)
+{
+    {
+        std::lock_guard lock(mutex);
+        auto [it, inserted] = states.try_emplace(kernelVariantKey(params), State::Queued);
+        if (!inserted && it->second != State::Failed) return;
+        it->second = State::Queued;
+    }
+    load(params);
+}
+
+bool KernelVariantCache::ready(const FractalParams& params)
+{
+    // without the builder thread the first launch loads the variant
+    if (!active()) return true;
+    std::lock_guard lock(mutex);
+    auto [it, inserted] = states.try_emplace(kernelVariantKey(params), State::Queued);
+    // every variant is pushed once, the queue never fills up and the render thread never waits here
+    if (inserted) queue.push(params);
+    return it->second == State::Ready;
+}
+
+void KernelVariantCache::builderLoop()
+{
+    FractalParams params;
+    while (queue.pop(params)) load(params);
+}
+
+void KernelVariantCache::load(const FractalParams& params)
+{
+    auto start = std::chrono::steady_clock::now();
+    bool ok = loader(params);
+    lastLoadTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (ok) ++loaded;
+
+    std::lock_guard lock(mutex);
+    states[kernelVariantKey(params)] = ok ? State::Ready : State::Failed;
+}
@@ -0,0 +1,68 @@
+#ifndef KERNEL_VARIANT_CACHE_H
+#define KERNEL_VARIANT_CACHE_H
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "fractal/fractal_params.h"
+#include "utility/bounded_queue.h"
+
+// Background loading of the kernel variants specialized for a parameter set.
+// Every variant is compiled at build time (one instantiation per estimator of dispatchDistanceEstimator), but the
+// CUDA driver loads the kernels of a variant only on their first launch: with lazy module loading, or when the binary
+// holds no code for the GPU and the PTX is compiled. The first frame after the parameters switch to a new variant
+// stalls for it, the most for the fully unrolled static Mandelbulbs.
+// The cache loads a variant on its builder thread the first time its parameters are asked for. Until it is ready the
+// frames set FrameConstants::genericKernel and render with the generic estimator, whose kernels are loaded up front
+// (prepare). The next frame after the load swaps to the variant, no frame waits for it.
+// The CPU backend has nothing to load, its variants are functions of the executable
+
+// the variant of params: the estimator dispatchDistanceEstimator instantiates for them. Parameters the estimator
+// reads at runtime share a variant
+uint64_t kernelVariantKey(const FractalParams& params);
+
+// loads the kernels of the variant of params, false if it could not
+using KernelVariantLoader = std::function<bool(const FractalParams& params)>;
+
+class KernelVariantCache {
+public:
+    // more than there are variants, every variant is queued once at most
+    static constexpr size_t cMaxQueuedVariants = 32;
+
+    ~KernelVariantCache() { stop(); }
+
+    // starts the builder thread, the variants are loaded with loader
+    void start(KernelVariantLoader loader);
+    // waits for the variant being loaded, the queued ones are dropped
+    void stop();
+    // loads the variant of params on the calling thread
+    void prepare(const FractalParams& params);
+    // true if the variant of params is loaded. The first call for a variant queues it for the builder thread
+    bool ready(const FractalParams& params);
+
+    bool active() const { return builder.joinable(); }
+    uint32_t variantsLoaded() const { return loaded; }
+    // time the builder thread took for the last variant
+    float lastLoadMilliseconds() const { return lastLoadTime; }
+
+private:
+    enum class State {
+        Queued, Ready, Failed
+    };
+
+    void builderLoop();
+    // loads params and records the result
+    void load(const FractalParams& params);
+
+    KernelVariantLoader loader;
+    std::thread builder;
+    BoundedQueue<FractalParams> queue{ cMaxQueuedVariants };
+    std::mutex mutex; // of states
+    std::unordered_map<uint64_t, State> states; // by kernelVariantKey
+    std::atomic<uint32_t> loaded = 0;
+    std::atomic<float> lastLoadTime = 0.0f;
+};
+
+#endif//KERNEL_VARIANT_CACHE_H
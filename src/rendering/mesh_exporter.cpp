@@ -0,0 +1,35 @@
+#include "rendering/mesh_exporter.h"
+#include "utility/thread_pool.h"
+
+bool MeshExporter::start(const std::filesystem::path& path, const FrameConstants& frame, const FractalMeshSettings& settings)
+{
+    if (active()) return false;
+    meshPath = path;
+    progress.chunkCount = 0;
+    progress.chunksDone = 0;
+    progress.cancel = false;
+    done = false;
+    FractalMeshSettings batched = settings;
+    if (batched.chunksPerBatch == 0) batched.chunksPerBatch = (int)theThreadPool.threadCount();
+    worker = std::thread([this, frame, batched] {
+        ok = writeFractalMeshObj(meshPath, frame, batched, &stats, &progress);
+        done = true;
+    });
+    return true;
+}
+
+void MeshExporter::stop()
+{
+    if (!active()) return;
+    progress.cancel = true;
+    worker.join();
+}
+
+bool MeshExporter::finished(bool& ok, FractalMeshStats& stats)
+{
+    if (!active() || !done) return false;
+    worker.join();
+    ok = this->ok;
+    stats = this->stats;
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef MESH_EXPORTER_H
+#define MESH_EXPORTER_H
+#include <atomic>
+#include <filesystem>
+#include <thread>
+#include "cpu/fractal_mesher.h"
+
+// OBJ export of the fractal surface in the background.
+// The worker thread runs writeFractalMeshObj, the chunks are meshed on theThreadPool one per thread at a time: the
+// pool runs one job after the other, so a CPU frame waits for one chunk at most and the GUI keeps running. The
+// renderer polls finished every frame, stop cancels the job before its next batch and removes the partial file
+
+class MeshExporter {
+public:
+    ~MeshExporter() { stop(); }
+
+    // meshes frame's fractal into path, false if a job is running
+    bool start(const std::filesystem::path& path, const FrameConstants& frame, const FractalMeshSettings& settings);
+    // cancels the job and waits for the worker
+    void stop();
+    // true once the job is over, the worker is joined. ok is false if the file could not be written
+    bool finished(bool& ok, FractalMeshStats& stats);
+
+    bool active() const { return worker.joinable(); }
+    const std::filesystem::path& path() const { return meshPath; }
+    size_t chunkCount() const { return progress.chunkCount; }
+    size_t chunksDone() const { return progress.chunksDone; }
+
+private:
+    std::filesystem::path meshPath;
+    FractalMeshProgress progress;
+    FractalMeshStats stats;
+    bool ok = false;
+    std::atomic<bool> done = false;
+    std::thread worker;
+};
+
+#endif//MESH_EXPORTER_H
@@ -0,0 +1,72 @@
+#include "rendering/pixel_statistics.h"
+#include <algorithm>
+#include <cstdio>
+
+const char* toString(PixelCounter counter)
+{
+    switch (counter) {
+    case PixelCounter::MarchSteps: return "march_steps";
+    case PixelCounter::DEIterations: return "de_iterations";
+    case PixelCounter::EscapeIteration: return "escape_iteration";
+    default: return "normal_taps";
+    }
+}
+
+PixelStatistics computePixelStatistics(const PixelCounters* counters, uint32_t width, uint32_t height, int bins)
+{
+    PixelStatistics statistics;
+    statistics.width = width;
+    statistics.height = height;
+    size_t pixels = (size_t)width * height;
+    if (pixels == 0 || bins <= 0) return statistics;
+
+    // counting sort of every counter, the values are small (step budget times iterations at most)
+    std::vector<uint32_t> values(pixels);
+    for (int c = 0; c < cPixelCounterCount; ++c) {
+        CounterStatistics& s = statistics.counters[c];
+        for (size_t i = 0; i < pixels; ++i) {
+            values[i] = pixelCounterValue(counters[i], (PixelCounter)c);
+            s.total += values[i];
+            s.max = std::max(s.max, values[i]);
+        }
+        s.mean = (double)s.total / (double)pixels;
+
+        std::vector<uint32_t> count((size_t)s.max + 1, 0);
+        for (uint32_t v : values) ++count[v];
+        auto percentile = [&](double q) {
+            size_t rank = std::min((size_t)(q * (double)pixels), pixels - 1), seen = 0;
+            for (uint32_t v = 0; v <= s.max; ++v) {
+                seen += count[v];
+                if (seen > rank) return v;
+            }
+            return s.max;
+        };
+        s.p50 = percentile(0.5);
+        s.p90 = percentile(0.9);
+        s.p99 = percentile(0.99);
+
+        s.binWidth = s.max / (uint32_t)bins + 1;
+        s.histogram.assign((size_t)s.max / s.binWidth + 1, 0.0f);
+        for (uint32_t v = 0; v <= s.max; ++v) s.histogram[v / s.binWidth] += (float)count[v];
+    }
+    return statistics;
+}
+
+bool writePixelCountersCsv(const std::filesystem::path& path, const PixelCounters* counters, uint32_t width, uint32_t height)
+{
+    FILE* file = fopen(path.string().c_str(), "w");
+    if (!file) return false;
+
+    fprintf(file, "x,y");
+    for (int c = 0; c < cPixelCounterCount; ++c) fprintf(file, ",%s", toString((PixelCounter)c));
+    fprintf(file, "\n");
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const PixelCounters& p = counters[(size_t)y * width + x];
+            fprintf(file, "%u,%u,%u,%u,%u,%u\n", x, y, p.marchSteps, p.deIterations, p.escapeIteration, p.normalTaps);
+        }
+    }
+    bool ok = ferror(file) == 0;
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
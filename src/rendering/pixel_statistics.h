@@ -0,0 +1,35 @@
+#ifndef PIXEL_STATISTICS_H
+#define PIXEL_STATISTICS_H
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include "fractal/pixel_counters.h"
+
+// Host side evaluation of the counters of an instrumented frame (see fractal/pixel_counters.h): distribution of every
+// counter over the pixels and a CSV dump for offline analysis
+
+struct CounterStatistics {
+    double mean = 0.0;
+    uint32_t max = 0;
+    uint32_t p50 = 0, p90 = 0, p99 = 0;
+    uint64_t total = 0;
+    // pixels per bin, bin i counts the values [i * binWidth, (i + 1) * binWidth)
+    std::vector<float> histogram;
+    uint32_t binWidth = 1;
+};
+
+struct PixelStatistics {
+    uint32_t width = 0, height = 0;
+    std::array<CounterStatistics, cPixelCounterCount> counters;
+
+    const CounterStatistics& operator[](PixelCounter counter) const { return counters[(int)counter]; }
+};
+
+// statistics of the width x height counters (rows of width), histograms of at most bins bins
+PixelStatistics computePixelStatistics(const PixelCounters* counters, uint32_t width, uint32_t height, int bins = 64);
+// one line per pixel: x,y and the counters in the order of PixelCounter, with a header line. false if path could not be written
+bool writePixelCountersCsv(const std::filesystem::path& path, const PixelCounters* counters, uint32_t width, uint32_t height);
+const char* toString(PixelCounter counter);
+
+#endif//PIXEL_STATISTICS_H
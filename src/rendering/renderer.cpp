@@ -4,6 +4,7 @@
 #include "window_manager.h"
 #include "vulkan_layer.h"
 #include "gui/gui_manager.h"
+#include "gui/imgui_ext.h"
 #include "scene/game_object.h"
 #include "scene/lights.h"
 #include "scene/game_scene.h"
@@ -12,6 +13,9 @@
 #include "utility/utility.hpp"
 #include "rendering/renderer_dependency_provider.h"
 #include "cuda/interop.cuh"
+#include "cpu/cpu_backend.h"
+#include "fractal/mandelbulb.h"
+#include "fractal/deep_zoom.h"
 #include "dxgi1_2.h"
 
 using namespace glfwim;
@@ -43,6 +47,21 @@ void Renderer::update(double dt)
 
 void Renderer::initialize()
 {
+    cudaAvailable = isCudaAvailable();
+    if (!cudaAvailable) {
+        logger.LogInfo("No CUDA capable device found, using the CPU backend");
+        backend = Backend::Cpu;
+    } else {
+        // the generic kernels of every fractal type render while the specialized ones load
+        kernelVariants.start(loadCudaKernelVariant);
+        for (int type = 0; type < cFractalTypeCount; ++type) {
+            FractalParams params;
+            params.type = (FractalType)type;
+            params.formula = FormulaMode::Trigonometric; // DynamicMandelbulb, the other types have one estimator each
+            kernelVariants.prepare(params);
+        }
+    }
+
     query.create();
     createResources();
     createPipelineLayout();
@@ -106,6 +125,10 @@ void Renderer::initialize()
 
 void Renderer::destroy()
 {
+    tiledRenderer.finish();
+    animationRenderer.finish();
+    meshExporter.stop();
+    kernelVariants.stop();
     query.destroy();
     descriptorPoolBuilder.destroy();
     perFrameDscSetBuilder.destroyLayout();
@@ -115,7 +138,10 @@ void Renderer::destroy()
     theVulkanLayer.device.destroy(fsPipeline);
     vmaDestroyPool(theVulkanLayer.allocator, externalPool);
 
-    freeExportedSemaphores();
+    if (cudaAvailable) {
+        freeExportedSemaphores();
+        freeCudaBrickMap();
+    }
     theVulkanLayer.device.destroy(cudaWaitsForVulkanSemaphore);
     theVulkanLayer.device.destroy(vulkanWaitsForCudaSemaphore);
 }
@@ -128,7 +154,9 @@ void Renderer::initializeSwapChainDependentComponents()
 
 void Renderer::destroySwapChainDependentComponents()
 {
-    freeExportedVulkanImage();
+    if (cudaAvailable) freeExportedVulkanImage();
+    freeCpuImage();
+    for (auto& it : cpuStagingBuffers) it.destroy();
     colorImage.destroy();
 }
 
@@ -141,20 +169,130 @@ void Renderer::render(const RenderContext& ctx)
     query.query();
     // not representative with cuda!
     theGUIManager.addStatistic("Renderer", std::make_tuple("Frame time: ", (query.results[1] - query.results[0]) * vl.timestampPeriod / 1e6, " ms"));
-    
+
+    updateGui();
+
     auto vp = vk::Viewport{ 0, 0, (float)wm.swapChainExtent.width, (float)wm.swapChainExtent.height, 0.0, 1.0 };
 ;
     // Update uniforms
     // per frame uniforms /* unused */
+    FrameConstants frame = buildFrameConstants(dynamicResolution.scaled(colorImage.width), dynamicResolution.scaled(colorImage.height));
+    frame.instrumentation = instrumentation;
+    frame.heatmap = instrumentation && heatmap;
+    frame.heatmapCounter = heatmapCounter;
+    frame.heatmapMax = heatmapMax;
+    // progressive frames antialias by accumulating jittered samples while the view is still, instrumented frames count
+    // the primary samples only
+    if (edgeAntialiasing && !progressiveRefinement && !instrumentation) {
+        frame.edgeSamples = (uint32_t)edgeSamples;
+        frame.edgeThreshold = edgeThreshold;
+        frame.edgeBudget = edgeBudget;
+    }
+
     PerFrameUniformData fud = {}; // prepare uniform data on CPU
     fud.v = ctx.cam->V();
     fud.ambientLight = glm::vec4{ ctx.pGameScene->ambientLight.color, ctx.pGameScene->ambientLight.power };
+    // the backends fill the top left frame.width x frame.height texels, copy.frag stretches them over the screen.
+    // Bilinear taps must not reach the stale texels next to them
+    glm::vec2 imageSize = glm::vec2(colorImage.width, colorImage.height);
+    glm::vec2 frameSize = glm::vec2(frame.width, frame.height);
+    fud.renderScale = glm::vec4(frameSize / imageSize, (frameSize - 0.5f) / imageSize);
     memcpy(perFrameBuffers[ctx.frameID].allocationInfo.pMappedData, &fud, sizeof(PerFrameUniformData)); // upload to GPU through mapped pointer
     perFrameBuffers[ctx.frameID].flush(); // ensure visibility
 
     query.beginFrame(ctx.cmd); // reset query
     query.write(ctx.cmd, vk::PipelineStageFlagBits::eTopOfPipe); // write timestamp
 
+    // the brick map is built once the fractal stops changing, building one per frame while it rotates would stall
+    if (usesBrickMap(frame, backend) && !brickMapCache.matches(frame) && BrickMapCache::brickMapKey(frame) == BrickMapCache::brickMapKey(previousFrame)) {
+        updateBrickMap(frame);
+    }
+    frame.brickMap = usesBrickMap(frame, backend) && brickMapCache.matches(frame);
+
+    // colorImage still holds the image of these parameters if the same backend rendered them last
+    uint64_t imageHash = hashImage(frame);
+    bool unchanged = imageHash == previousImageHash && previousBackend == backend;
+    // progressive refinement continues as long as nothing changes the image, see cRefinementSubsets.
+    // Instrumented frames are full frames, the counters of a refinement pass only cover its pixels
+    if (progressiveRefinement && !frame.instrumentation) {
+        frame.progressive = true;
+        frame.refinementPass = unchanged && previousFrame.progressive ? previousFrame.refinementPass + 1 : 0;
+    }
+    // the image in colorImage is final, it only has to be copied to the screen again
+    bool converged = frame.progressive ? frame.refinementPass >= cRefinementSubsets + (uint32_t)refinementSamples - 1 : unchanged && !previousFrame.progressive;
+    // an offline render or animation takes one tile or frame per frame on the CPU backend. They overwrite its image,
+    // accumulation and hit distances, so its view keeps the last image and starts over once the job is done
+    bool offlineTile = tiledRenderer.active() && renderOfflineTile();
+    bool animationFrame = !offlineTile && animationRenderer.active() && renderAnimationFrame();
+    bool offlineWork = offlineTile || animationFrame;
+    if (offlineWork && backend == Backend::Cpu) {
+        converged = true;
+        previousFrame = {};
+        previousImageHash = 0;
+    }
+
+    // the hit distances kept by the backend only match if it rendered the same fractal in the previous frame from the same position.
+    // theta is not a rigid rotation (c stays in world space), a new objectRotation is a new fractal.
+    // Progressive passes after the first do not write hit distances, the deep zoom path writes imprecise ones
+    frame.reprojection = temporalReprojection && previousBackend == backend && !frame.deepZoom && !previousFrame.deepZoom &&
+        previousFrame.width == frame.width && previousFrame.height == frame.height && previousFrame.fractal == frame.fractal &&
+        previousFrame.objectRotation == frame.objectRotation && glm::vec3(previousFrame.rayTransform[3]) == glm::vec3(frame.rayTransform[3]) &&
+        (!previousFrame.progressive || previousFrame.refinementPass == 0);
+    if (frame.reprojection) {
+        frame.previousInverseRay = glm::inverse(glm::mat3(previousFrame.rayTransform));
+        frame.historyStep = previousFrame.progressive ? 2 : 1;
+    }
+    if (!converged) {
+        previousFrame = frame;
+        previousImageHash = imageHash;
+        previousBackend = backend;
+    }
+    // the first progressive passes shade one pixel of each 2x2 block, their render time says nothing about a full frame
+    bool feedsResolution = !frame.progressive || frame.refinementPass >= cRefinementSubsets;
+
+    cudaInteropActive = backend == Backend::Cuda && !converged;
+    if (offlineTile) {
+        theGUIManager.addStatistic("Renderer", std::make_tuple("Offline render: ", tiledRenderer.tilesWritten(), " / ", tiledRenderer.tileCount(), " tiles"));
+    }
+    if (animationFrame) {
+        theGUIManager.addStatistic("Renderer", std::make_tuple("Animation: ", animationRenderer.framesWritten(), " / ", animationRenderer.frameCount(), " frames (render ",
+            animationRenderer.renderMilliseconds(), " ms, encode ", animationRenderer.encodeMilliseconds(), " ms, write ", animationRenderer.writeMilliseconds(), " ms)"));
+    }
+    if (meshExporter.active()) updateMeshExport();
+    if (converged && offlineWork && backend == Backend::Cpu) {
+        theGUIManager.addStatistic("Renderer", std::make_tuple("View paused by the offline render"));
+    } else if (converged) {
+        theGUIManager.addStatistic("Renderer", std::make_tuple("Image unchanged, not rendered"));
+    } else if (cudaInteropActive) {
+        frame.genericKernel = !kernelVariants.ready(frame.fractal);
+        renderCuda(frame);
+        if (frame.instrumentation) updatePixelStatistics(frame);
+        // the kernels run asynchronously, each finished timing is used once with the scale and pass it was measured at
+        CudaRenderTiming timing;
+        if (takeCudaRenderTiming(&timing) && timing.fullFrame) dynamicResolution.update(timing.milliseconds, timing.scale);
+        theGUIManager.addStatistic("Renderer", std::make_tuple("CUDA frame time: ", getCudaRenderMilliseconds(), " ms"));
+    } else {
+        renderCpu(frame);
+        if (frame.instrumentation) updatePixelStatistics(frame);
+        auto stats = getCpuRenderStats();
+        if (feedsResolution) dynamicResolution.update(stats.milliseconds, dynamicResolution.scale());
+        theGUIManager.addStatistic("Renderer", std::make_tuple("CPU frame time: ", stats.milliseconds, " ms"));
+        theGUIManager.addStatistic("Renderer", std::make_tuple("CPU steps per sample: ", stats.stepsPerSample));
+        if (frame.edgeSamples > 0) theGUIManager.addStatistic("Renderer", std::make_tuple("CPU edge pixels: ", stats.edgePixels));
+        theGUIManager.addStatistic("Renderer", std::make_tuple("CPU throughput: ", stats.megapixelsPerSecond, " Mpixel/s (", stats.threadCount, " threads, ", stats.tileCount, " tiles, ", toString(stats.isa), ")"));
+        uploadCpuImage(ctx, frame.width, frame.height); // copies are not allowed inside the render pass
+    }
+    if (frame.progressive && !converged) {
+        theGUIManager.addStatistic("Renderer", std::make_tuple("Refinement pass: ", frame.refinementPass + 1, " / ", cRefinementSubsets + refinementSamples - 1));
+    }
+    theGUIManager.addStatistic("Renderer", std::make_tuple("Render resolution: ", frame.width, " x ", frame.height));
+    theGUIManager.addStatistic("Renderer", std::make_tuple("Step budget: ", frame.fractal.maxRaySteps));
+    theGUIManager.addStatistic("Renderer", std::make_tuple("Zoom: ", zoom, frame.deepZoom ? " (deep zoom path)" : ""));
+    if (useBrickMap) {
+        theGUIManager.addStatistic("Renderer", std::make_tuple("Brick map: ", brickMapCache.brickCount(), " bricks, ", brickMapCache.memoryBytes() / (1024 * 1024), " MiB, ",
+            brickMapCache.buildMilliseconds(), " ms", frame.brickMap ? "" : " (not in use)"));
+    }
+
     // prepare render pass
     vk::RenderingAttachmentInfo colorInfo = {}; // color attachment (render target)
     colorInfo.imageView = wm.swapChainImageViews[ctx.imageID];
@@ -172,8 +310,6 @@ void Renderer::render(const RenderContext& ctx)
     
     ctx.cmd.beginRendering(renderingInfo); // start render pass
 
-    renderCuda(zoom, offsetX, offsetY, theta[0], theta[1], theta[2], normal_surface);
-
     ctx.cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, fsPipelineLayout, 0, 1, &perFrameDescriptorSets[ctx.frameID], 0, nullptr);
     ctx.cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, fsPipeline);
     ctx.cmd.setViewport(0, 1, &vp);
@@ -187,6 +323,375 @@ void Renderer::render(const RenderContext& ctx)
     query.endFrame();
 }
 
+FrameConstants Renderer::buildFrameConstants(uint32_t width, uint32_t height) const
+{
+    return buildFrameConstants(currentView(), width, height);
+}
+
+FrameConstants Renderer::buildFrameConstants(const AnimationKey& view, uint32_t width, uint32_t height) const
+{
+    FrameConstants frame = {};
+    glm::dmat4 rayTransform = buildRayTransform(view.zoom, view.offsetX, view.offsetY);
+    frame.rayTransform = glm::mat4(rayTransform);
+    frame.objectRotation = buildObjectRotation(view.theta);
+    frame.fractal = fractal;
+    frame.fractal.power = view.power;
+    frame.boundingRadius = boundingSphere ? fractalBoundingRadius(frame.fractal) : 0.0f;
+    frame.width = width;
+    frame.height = height;
+    frame.normalSurface = normal_surface;
+    frame.conePrepass = conePrepass;
+    adaptToPixelFootprint(frame);
+    if (deepZoomMode) adaptToDeepZoom(frame, rayTransform);
+    return frame;
+}
+
+AnimationKey Renderer::currentView() const
+{
+    AnimationKey view;
+    view.zoom = zoom;
+    view.offsetX = offsetX;
+    view.offsetY = offsetY;
+    view.theta = theta;
+    view.power = fractal.power;
+    return view;
+}
+
+void Renderer::updateGui()
+{
+    int selected = (int)backend;
+    if (ImGui::Combo("Backend", &selected, "CUDA\0CPU\0")) {
+        if ((Backend)selected == Backend::Cuda && !cudaAvailable) {
+            logger.LogError("CUDA backend selected but no CUDA capable device is available");
+        } else {
+            backend = (Backend)selected;
+        }
+    }
+    if (backend == Backend::Cpu) {
+        int isa = (int)getCpuSimdIsa();
+        if (ImGui::Combo("SIMD", &isa, "Scalar\0AVX2\0AVX-512\0")) {
+            if (!isSimdIsaSupported((SimdIsa)isa)) {
+                logger.LogError(toString((SimdIsa)isa), " is not supported by this processor");
+            } else {
+                setCpuSimdIsa((SimdIsa)isa);
+            }
+        }
+    }
+    ImGui::Combo("Fractal", (int*)&fractal.type, "Mandelbulb\0Mandelbox\0Quaternion Julia\0Menger sponge\0");
+    if (fractal.type == FractalType::Mandelbulb) {
+        ImGui::Combo("Formula", (int*)&fractal.formula, "Trigonometric\0Triplex\0");
+        ImGui::DragFloat("Power", &fractal.power, 0.05f, 1.0f, 16.0f);
+    } else if (fractal.type == FractalType::Mandelbox) {
+        // the box is unbounded for |scale| <= 1
+        if (ImGui::DragFloat("Box scale", &fractal.boxScale, 0.01f, -4.0f, 4.0f) && fabsf(fractal.boxScale) < 1.1f) {
+            fractal.boxScale = copysignf(1.1f, fractal.boxScale);
+        }
+    } else if (fractal.type == FractalType::QuaternionJulia) {
+        ImGui::DragFloat4("Julia c", &fractal.juliaC.x, 0.005f, -1.5f, 1.5f);
+    }
+    ImGui::SliderInt("Iterations", &fractal.iterations, 1, 64);
+    ImGui::SliderInt("Max ray steps", &fractal.maxRaySteps, 1, 1000);
+    ImGui::SliderFloat("Min distance", &fractal.minDistance, 1e-6f, 1e-2f, "%.6f", ImGuiSliderFlags_Logarithmic);
+    ImGui::SliderFloat("Hit threshold (pixels)", &fractal.footprintEpsilon, 0.0f, 2.0f, fractal.footprintEpsilon > 0.0f ? "%.2f" : "min distance");
+    ImGui::Checkbox("Adaptive step budget", &fractal.adaptiveSteps);
+    ImGui::SliderFloat("Over-relaxation", &fractal.overRelaxation, 1.0f, 2.0f, fractal.overRelaxation > 1.0f ? "%.2f" : "off");
+    bool loading = isSpecialized(fractal) && backend == Backend::Cuda && !kernelVariants.ready(fractal);
+    theGUIManager.addStatistic("Renderer", std::make_tuple("Kernel: ", loading ? "generic, specialized one loading" : isSpecialized(fractal) ? "specialized" : "generic"));
+    if (kernelVariants.active()) {
+        theGUIManager.addStatistic("Renderer", std::make_tuple("Kernel variants loaded: ", kernelVariants.variantsLoaded(), " (last ", kernelVariants.lastLoadMilliseconds(), " ms)"));
+    }
+    ImGui::Checkbox("Normal surface", &normal_surface);
+    ImGui::SameLine();
+    ImGui::Checkbox("Instrumentation", &instrumentation);
+    if (instrumentation) pixelStatisticsGui();
+    ImGui::Combo("Normals", (int*)&fractal.normalMode, "Central differences\0Analytic\0");
+    ImGui::Checkbox("Bounding sphere", &boundingSphere);
+    ImGui::Checkbox("Cone prepass", &conePrepass);
+    if (ImGui::Checkbox("Distance field cache", &useBrickMap) && !useBrickMap) {
+        brickMapCache.clear();
+        setCpuBrickMap(brickMapCache.view());
+        if (cudaAvailable) freeCudaBrickMap();
+    }
+    ImGui::Checkbox("Deep zoom (automatic)", &deepZoomMode);
+    ImGui::Checkbox("Temporal reprojection", &temporalReprojection);
+    ImGui::Checkbox("Progressive refinement", &progressiveRefinement);
+    if (progressiveRefinement) ImGui::SliderInt("Samples per pixel", &refinementSamples, 1, 64);
+    if (!progressiveRefinement) {
+        ImGui::Checkbox("Edge antialiasing", &edgeAntialiasing);
+        if (edgeAntialiasing) {
+            ImGui::SliderInt("Edge samples", &edgeSamples, 1, 16);
+            ImGui::SliderFloat("Edge threshold", &edgeThreshold, 0.01f, 1.0f);
+            ImGui::SliderFloat("Edge budget", &edgeBudget, 0.0f, 1.0f);
+        }
+    }
+    if (!meshExporter.active()) {
+        ImGui::SliderInt("Mesh resolution", &meshSettings.resolution, 32, 1024);
+        if (ImGui::Button("Export mesh (OBJ)")) exportMesh();
+    } else if (ImGui::Button("Stop mesh export")) {
+        meshExporter.stop();
+        logger.LogInfo("Mesh export stopped, ", meshExporter.path().string(), " is removed");
+    }
+    if (!tiledRenderer.active()) {
+        ImGui::DragUInt32("Offline width", &offlineSettings.width, 64.0f, 16, 1u << 20);
+        ImGui::DragUInt32("Offline height", &offlineSettings.height, 64.0f, 16, 1u << 20);
+        ImGui::DragUInt32("Offline tile size", &offlineSettings.tileSize, 16.0f, 16, 4096);
+        ImGui::SliderInt("Offline samples per pixel", &offlineSettings.samples, 1, 64);
+        if (ImGui::Button("Render image (TIFF)")) startOfflineRender();
+    } else if (ImGui::Button("Stop offline render")) {
+        // the tiles on disk stay, starting the same render again continues it
+        uint32_t count = tiledRenderer.tileCount();
+        tiledRenderer.finish();
+        logger.LogInfo("Offline render stopped, ", tiledRenderer.tilesWritten(), " of ", count, " tiles are in ", tiledRenderer.path().string());
+    }
+    ImGui::Text("Animation: %d keys", (int)timeline.size());
+    if (ImGui::Button("Add key")) {
+        AnimationKey key = currentView();
+        key.time = timeline.empty() ? 0.0 : timeline.back().time + keyInterval;
+        timeline.push_back(key);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear keys")) timeline.clear();
+    ImGui::SameLine();
+    if (ImGui::Button("Load timeline")) {
+        if (!loadTimeline(cDirExports / "timeline.txt", timeline)) logger.LogError("Could not read a timeline from ", (cDirExports / "timeline.txt").string());
+    }
+    ImGui::SliderFloat("Seconds to the next key", &keyInterval, 0.1f, 30.0f, "%.1f");
+    if (!animationRenderer.active()) {
+        ImGui::DragUInt32("Animation width", &animationSettings.width, 8.0f, 16, 8192);
+        ImGui::DragUInt32("Animation height", &animationSettings.height, 8.0f, 16, 8192);
+        ImGui::SliderFloat("Frames per second", &animationSettings.framesPerSecond, 1.0f, 120.0f, "%.0f");
+        ImGui::SliderInt("Animation samples per pixel", &animationSettings.samples, 1, 64);
+        if (timeline.size() >= 2 && ImGui::Button("Render animation (PNG)")) startAnimation();
+    } else if (ImGui::Button("Stop animation")) {
+        animationRenderer.finish();
+        logger.LogInfo("Animation stopped, ", animationRenderer.framesWritten(), " of ", animationRenderer.frameCount(), " frames are in ", animationRenderer.path().string());
+    }
+    ImGui::Checkbox("Dynamic resolution", &dynamicResolution.enabled);
+    if (dynamicResolution.enabled) {
+        ImGui::SliderFloat("Target render time (ms)", &dynamicResolution.targetMilliseconds, 1.0f, 100.0f, "%.1f");
+        ImGui::SliderFloat("Min resolution scale", &dynamicResolution.minScale, 0.1f, 1.0f, "%.2f");
+    }
+}
+
+void Renderer::updatePixelStatistics(const FrameConstants& frame)
+{
+    pixelCounters.resize((size_t)frame.width * frame.height);
+    if (backend == Backend::Cuda) {
+        readCudaPixelCounters(pixelCounters.data(), pixelCounters.size());
+    } else {
+        const PixelCounters* counters = getCpuPixelCounters();
+        std::copy(counters, counters + pixelCounters.size(), pixelCounters.begin());
+    }
+    pixelStatistics = computePixelStatistics(pixelCounters.data(), frame.width, frame.height);
+}
+
+void Renderer::pixelStatisticsGui()
+{
+    ImGui::Checkbox("Heatmap", &heatmap);
+    ImGui::SameLine();
+    ImGui::Combo("##heatmap counter", (int*)&heatmapCounter, "March steps\0DE iterations\0Escape iteration\0Normal taps\0");
+    const CounterStatistics& shown = pixelStatistics[heatmapCounter];
+    ImGui::DragFloat("Heatmap max", &heatmapMax, 1.0f, 0.0f, 1e6f, heatmapMax > 0.0f ? "%.0f" : "natural");
+    ImGui::SameLine();
+    if (ImGui::Button("Fit p99")) heatmapMax = (float)std::max(shown.p99, 1u);
+    if (!shown.histogram.empty()) {
+        char label[64];
+        snprintf(label, sizeof(label), "%u per bin", shown.binWidth);
+        ImGui::PlotHistogram("##counter histogram", shown.histogram.data(), (int)shown.histogram.size(), 0, label, 0.0f, FLT_MAX, ImVec2(0.0f, 80.0f));
+    }
+    for (int c = 0; c < cPixelCounterCount; ++c) {
+        const CounterStatistics& s = pixelStatistics.counters[c];
+        ImGui::Text("%-16s mean %8.2f  p50 %6u  p90 %6u  p99 %6u  max %6u", toString((PixelCounter)c), s.mean, s.p50, s.p90, s.p99, s.max);
+    }
+    if (ImGui::Button("Dump counters (CSV)")) dumpPixelCounters();
+}
+
+void Renderer::dumpPixelCounters() const
+{
+    if (pixelCounters.empty()) return;
+    char name[96];
+    snprintf(name, sizeof(name), "pixel_counters_%016llx_%ux%u.csv", (unsigned long long)previousImageHash, pixelStatistics.width, pixelStatistics.height);
+    auto path = cDirExports / name;
+    if (!writePixelCountersCsv(path, pixelCounters.data(), pixelStatistics.width, pixelStatistics.height)) {
+        logger.LogError("Could not write the pixel counters to ", path.string());
+        return;
+    }
+    logger.LogInfo("Wrote the counters of ", pixelCounters.size(), " pixels to ", path.string());
+}
+
+bool Renderer::usesBrickMap(const FrameConstants& frame, Backend target) const
+{
+    return useBrickMap && !frame.deepZoom && brickMapPaysOff(frame.fractal) && (target == Backend::Cuda || getCpuSimdIsa() == SimdIsa::Scalar);
+}
+
+void Renderer::updateBrickMap(const FrameConstants& frame)
+{
+    // a map saved by an earlier run is read in a fraction of the build time
+    if (!brickMapCache.load(cDirCache, frame)) {
+        brickMapCache.build(frame);
+        if (!brickMapCache.save(cDirCache)) logger.LogError("Could not write the brick map to ", brickMapCache.filePath(cDirCache, frame).string());
+    }
+    setCpuBrickMap(brickMapCache.view());
+    if (cudaAvailable) uploadCudaBrickMap(brickMapCache.view(), brickMapCache.brickCount());
+}
+
+void Renderer::exportMesh()
+{
+    FrameConstants frame = buildFrameConstants(colorImage.width, colorImage.height);
+    char name[96];
+    snprintf(name, sizeof(name), "%s_p%g_i%d_%016llx_%d.obj", toString(frame.fractal.type), frame.fractal.power, frame.fractal.iterations,
+        (unsigned long long)BrickMapCache::brickMapKey(frame), meshSettings.resolution);
+    auto path = cDirExports / name;
+
+    if (meshExporter.start(path, frame, meshSettings)) logger.LogInfo("Meshing ", meshSettings.resolution, "^3 cells to ", path.string());
+}
+
+void Renderer::updateMeshExport()
+{
+    bool ok;
+    FractalMeshStats stats;
+    if (!meshExporter.finished(ok, stats)) {
+        theGUIManager.addStatistic("Renderer", std::make_tuple("Mesh export: ", meshExporter.chunksDone(), " / ", meshExporter.chunkCount(), " chunks"));
+        return;
+    }
+    if (!ok) {
+        logger.LogError("Could not write the mesh to ", meshExporter.path().string());
+        return;
+    }
+    logger.LogInfo("Exported ", stats.triangles, " triangles to ", meshExporter.path().string(), " in ", stats.milliseconds, " ms");
+}
+
+void Renderer::startOfflineRender()
+{
+    // the tiles are rendered into the host image of the CPU backend, which has the size of colorImage
+    TiledRenderSettings settings = offlineSettings;
+    settings.tileSize = std::min(settings.tileSize, std::min(colorImage.width, colorImage.height)) / 16 * 16;
+    FrameConstants frame = buildFrameConstants(settings.width, settings.height);
+    frame.brickMap = usesBrickMap(frame, Backend::Cpu) && brickMapCache.matches(frame);
+    // the same view at the same size gets the same file, so a render that was stopped or crashed is continued
+    char name[96];
+    snprintf(name, sizeof(name), "mandelbulb_%016llx_%ux%u.tif", (unsigned long long)hashImage(frame), settings.width, settings.height);
+    auto path = cDirExports / name;
+
+    if (!tiledRenderer.start(path, frame, buildRayTransform(zoom, offsetX, offsetY), settings)) {
+        logger.LogError("Could not create ", path.string());
+        return;
+    }
+    if (tiledRenderer.tilesResumed() > 0) {
+        logger.LogInfo("Continuing the offline render of ", path.string(), ", ", tiledRenderer.tilesResumed(), " of ", tiledRenderer.tileCount(), " tiles are done");
+    }
+}
+
+bool Renderer::renderOfflineTile()
+{
+    // colorImage (and with it the host image) shrinks when the window does, the render waits for a larger one
+    if (tiledRenderer.tileSize() > std::min(colorImage.width, colorImage.height)) return false;
+
+    uint32_t imageWidth = colorImage.width;
+    bool rendered = tiledRenderer.renderNextTile([imageWidth](const FrameConstants& tile, uint32_t* pixels) {
+        renderCpu(tile);
+        if (!pixels) return;
+        const uint32_t* image = getCpuImage();
+        for (uint32_t y = 0; y < tile.height; ++y) memcpy(pixels + (size_t)y * tile.width, image + (size_t)y * imageWidth, tile.width * sizeof(uint32_t));
+    });
+    if (rendered) return true;
+
+    auto path = tiledRenderer.path();
+    if (!tiledRenderer.finish()) {
+        logger.LogError("Could not write the offline render to ", path.string());
+    } else {
+        logger.LogInfo("Offline render written to ", path.string());
+    }
+    return false;
+}
+
+void Renderer::startAnimation()
+{
+    // the frames are rendered into the host image of the CPU backend, which has the size of colorImage
+    AnimationSettings settings = animationSettings;
+    settings.width = std::min(settings.width, colorImage.width);
+    settings.height = std::min(settings.height, colorImage.height);
+    saveTimeline(cDirExports / "timeline.txt", timeline);
+    char name[64];
+    snprintf(name, sizeof(name), "animation_%016llx", (unsigned long long)hashImage(buildFrameConstants(timeline.front(), settings.width, settings.height)));
+    auto path = cDirExports / name;
+
+    if (!animationRenderer.start(path, timeline, settings)) {
+        logger.LogError("Could not start the animation in ", path.string());
+        return;
+    }
+    logger.LogInfo("Rendering ", animationRenderer.frameCount(), " frames of ", settings.width, " x ", settings.height, " to ", path.string());
+}
+
+bool Renderer::renderAnimationFrame()
+{
+    // colorImage (and with it the host image) shrinks when the window does, the animation waits for a larger one
+    if (animationRenderer.frameWidth() > colorImage.width || animationRenderer.frameHeight() > colorImage.height) return false;
+
+    uint32_t imageWidth = colorImage.width;
+    bool rendered = animationRenderer.renderNextFrame(
+        [this](const AnimationKey& view, uint32_t width, uint32_t height) {
+            FrameConstants frame = buildFrameConstants(view, width, height);
+            frame.brickMap = usesBrickMap(frame, Backend::Cpu) && brickMapCache.matches(frame);
+            return frame;
+        },
+        [imageWidth](const FrameConstants& frame, uint32_t* pixels) {
+            renderCpu(frame);
+            if (!pixels) return;
+            const uint32_t* image = getCpuImage();
+            for (uint32_t y = 0; y < frame.height; ++y) memcpy(pixels + (size_t)y * frame.width, image + (size_t)y * imageWidth, frame.width * sizeof(uint32_t));
+        });
+    if (rendered) return true;
+
+    if (!animationRenderer.finish()) {
+        logger.LogError("Could not write the animation to ", animationRenderer.path().string());
+    } else {
+        logger.LogInfo("Animation written to ", animationRenderer.path().string(), " (render ", animationRenderer.renderMilliseconds(), " ms, encode ",
+            animationRenderer.encodeMilliseconds(), " ms, write ", animationRenderer.writeMilliseconds(), " ms)");
+    }
+    return false;
+}
+
+void Renderer::uploadCpuImage(const RenderContext& ctx, uint32_t width, uint32_t height)
+{
+    // only the rendered top left corner, the rows keep the width of colorImage
+    auto& staging = cpuStagingBuffers[ctx.frameID];
+    memcpy(staging.allocationInfo.pMappedData, getCpuImage(), (size_t)colorImage.width * height * sizeof(uint32_t));
+    staging.flush();
+
+    vk::ImageMemoryBarrier2 bar = {};
+    bar.image = colorImage.image;
+    bar.oldLayout = vk::ImageLayout::eGeneral;
+    bar.newLayout = vk::ImageLayout::eGeneral;
+    bar.srcStageMask = vk::PipelineStageFlagBits2::eFragmentShader;
+    bar.srcAccessMask = vk::AccessFlagBits2::eShaderSampledRead;
+    bar.dstStageMask = vk::PipelineStageFlagBits2::eCopy;
+    bar.dstAccessMask = vk::AccessFlagBits2::eTransferWrite;
+    bar.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+    bar.subresourceRange.baseArrayLayer = 0;
+    bar.subresourceRange.layerCount = 1;
+    bar.subresourceRange.baseMipLevel = 0;
+    bar.subresourceRange.levelCount = 1;
+
+    vk::DependencyInfo dep = {};
+    dep.imageMemoryBarrierCount = 1;
+    dep.pImageMemoryBarriers = &bar;
+    ctx.cmd.pipelineBarrier2(dep); // previous frame finished sampling
+
+    vk::BufferImageCopy region = {};
+    region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.bufferRowLength = colorImage.width;
+    region.imageExtent = vk::Extent3D{ width, height, 1 };
+    ctx.cmd.copyBufferToImage(staging.buffer, colorImage.image, vk::ImageLayout::eGeneral, 1, &region);
+
+    std::swap(bar.srcStageMask, bar.dstStageMask);
+    std::swap(bar.srcAccessMask, bar.dstAccessMask);
+    ctx.cmd.pipelineBarrier2(dep); // copy visible to the fullscreen pass
+}
+
 void Renderer::createPipelineLayout()
 {
     descriptorPoolBuilder.initialize();
@@ -234,12 +739,24 @@ void Renderer::createImages()
         vk::SampleCountFlagBits::e1,
         vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eGeneral, // general layout so it is compatible (doesnt really matter as CUDA is nvidia specific)
         vk::ImageAspectFlagBits::eColor,
-        vk::ImageUsageFlagBits::eSampled, alloc, vk::ImageTiling::eOptimal, &extInfo // extension struct passed here
+        vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst, alloc, vk::ImageTiling::eOptimal, &extInfo // extension struct passed here
     ), "Renderer_ColorImage");
 
-    colorImageNativeHandle = colorImage.getNativeWin32Handle(); // receive a native win32 handle
-    // and finally export the image to CUDA
-    exportVulkanImageToCuda_R8G8B8A8Unorm(colorImageNativeHandle, colorImage.allocationInfo.size, colorImage.allocationInfo.offset, colorImage.width, colorImage.height);
+    if (cudaAvailable) {
+        colorImageNativeHandle = colorImage.getNativeWin32Handle(); // receive a native win32 handle
+        // and finally export the image to CUDA
+        exportVulkanImageToCuda_R8G8B8A8Unorm(colorImageNativeHandle, colorImage.allocationInfo.size, colorImage.allocationInfo.offset, colorImage.width, colorImage.height);
+    }
+
+    // the cpu backend renders into host memory and uploads through a staging buffer per frame in flight
+    allocateCpuImage(colorImage.width, colorImage.height);
+    // the backends start over with empty hit distance buffers and images
+    previousFrame = {};
+    previousImageHash = 0;
+    for (auto& it : cpuStagingBuffers) {
+        it = vl.createBuffer((vk::DeviceSize)colorImage.width * colorImage.height * sizeof(uint32_t), vk::BufferUsageFlagBits::eTransferSrc,
+            vma::AllocationCreateFlagBits::eHostAccessSequentialWriteBit | vma::AllocationCreateFlagBits::eCreateMappedBit);
+    }
 }
 
 void Renderer::createResources()
@@ -276,7 +793,7 @@ void Renderer::createResources()
     // this way the pool can select a correct memory type
     VkImageCreateInfo example = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
     example.format = (VkFormat)vk::Format::eR8G8B8A8Unorm;
-    example.usage = (VkImageUsageFlags)vk::ImageUsageFlagBits::eSampled;
+    example.usage = (VkImageUsageFlags)(vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst);
     example.imageType = (VkImageType)vk::ImageType::e2D;
     example.initialLayout = (VkImageLayout)vk::ImageLayout::eUndefined;
     example.samples = (VkSampleCountFlagBits)vk::SampleCountFlagBits::e1;
@@ -346,5 +863,5 @@ void Renderer::createSyncObjects()
     cudaWaitsForVulkanSemaphore = theVulkanLayer.device.createSemaphore(semaphoreInfo);
     vulkanWaitsForCudaSemaphore = theVulkanLayer.device.createSemaphore(semaphoreInfo);
 
-    exportSemaphoresToCuda(theVulkanLayer.getNativeWin32Handle(cudaWaitsForVulkanSemaphore), theVulkanLayer.getNativeWin32Handle(vulkanWaitsForCudaSemaphore));
+    if (cudaAvailable) exportSemaphoresToCuda(theVulkanLayer.getNativeWin32Handle(cudaWaitsForVulkanSemaphore), theVulkanLayer.getNativeWin32Handle(vulkanWaitsForCudaSemaphore));
 }
\ No newline at end of file
@@ -4,6 +4,14 @@
 #include "constants.h"
 #include "shader_manager.h"
 #include "utility/utility.hpp"
+#include "fractal/frame_constants.h"
+#include "rendering/dynamic_resolution.h"
+#include "cpu/brick_map_cache.h"
+#include "rendering/mesh_exporter.h"
+#include "rendering/tiled_renderer.h"
+#include "rendering/animation_renderer.h"
+#include "rendering/pixel_statistics.h"
+#include "rendering/kernel_variant_cache.h"
 
 struct RendererDependency;
 
@@ -17,17 +25,61 @@ public:
     void render(const RenderContext& ctx);
     void update(double dt);
     void update_helper(float& value, const char* key1, const char* key2);
+    // true if the last recorded frame was rendered by CUDA and the submission has to wait for / signal the interop semaphores
+    bool usesCudaInterop() const { return cudaInteropActive; }
+
+    enum class Backend : int {
+        Cuda, Cpu
+    };
 
 private:
-    float zoom = 1.0f;
-    float zoom_div = 1.0;
-    float offsetX = 0.0;
-    float offsetY = 0.0;
+    // double, the deep zoom path goes far past the float resolution of the view
+    double zoom = 1.0;
+    double zoom_div = 1.0;
+    double offsetX = 0.0;
+    double offsetY = 0.0;
     glm::vec3 theta = { 0.0, 0.0, 0.0 };
     glm::vec3 rotation = { 0.0, 0.0, 0.0 };
     bool directionChanging = false;
     glm::vec2 lastCursorPos = { 0, 0 };
     bool normal_surface = false;
+    // per pixel counters of the backends (fractal/pixel_counters.h), shown as statistics and optionally as a heatmap
+    bool instrumentation = false;
+    bool heatmap = true;
+    PixelCounter heatmapCounter = PixelCounter::MarchSteps;
+    float heatmapMax = 0.0f; // 0: the natural maximum of the counter
+    std::vector<PixelCounters> pixelCounters; // host copy of the counters of the last instrumented frame
+    PixelStatistics pixelStatistics; // of pixelCounters
+    FractalParams fractal;
+    bool boundingSphere = true; // clip rays to the bounding sphere of the fractal
+    bool conePrepass = true; // start pixel rays at the distance of a per tile cone march
+    bool useBrickMap = false; // march through the cached distance field of fractal/brick_map.h
+    BrickMapCache brickMapCache;
+    FractalMeshSettings meshSettings; // of the OBJ export
+    MeshExporter meshExporter;
+    TiledRenderSettings offlineSettings; // of the offline TIFF render
+    TiledRenderer tiledRenderer;
+    std::vector<AnimationKey> timeline; // keys of the animation, sorted by time
+    float keyInterval = 2.0f; // seconds between a new key and the last one
+    AnimationSettings animationSettings;
+    AnimationRenderer animationRenderer;
+    bool deepZoomMode = true; // switch to the perturbation path of fractal/deep_zoom.h when float runs out of precision
+    bool temporalReprojection = false; // start pixel rays near the hit distance of the previous frame. Off by default, see reprojectStart
+    FrameConstants previousFrame = {}; // last frame handed to a backend, width 0 until the first frame after createImages
+    uint64_t previousImageHash = 0; // hashImage(previousFrame), 0 if colorImage holds no image
+    Backend previousBackend = Backend::Cuda;
+    DynamicResolution dynamicResolution;
+    bool progressiveRefinement = true; // quarter resolution while the view changes, refined and antialiased while it is still
+    int refinementSamples = 16; // samples per pixel of a converged progressive image
+    // edge-adaptive supersampling of full frames (fractal/edge_antialiasing.h), without progressive refinement only
+    bool edgeAntialiasing = true;
+    int edgeSamples = 4; // extra samples of an edge pixel
+    float edgeThreshold = 0.1f; // contrast to a neighbour that makes a pixel an edge
+    float edgeBudget = 0.25f; // largest fraction of the pixels that get the extra samples
+    Backend backend = Backend::Cuda;
+    bool cudaAvailable = false;
+    KernelVariantCache kernelVariants; // of the CUDA backend, loads the specialized kernels in the background
+    bool cudaInteropActive = false;
 
     struct DependentComponents {
         vk::Pipeline pipeline = nullptr;
@@ -51,6 +103,7 @@ private:
     struct PerFrameUniformData {
         glm::mat4 v;
         glm::vec4 ambientLight;
+        glm::vec4 renderScale; // xy: rendered fraction of colorImage, zw: largest uv copy.frag may sample
     };
 
     struct alignas(16) PerObjectUniformData {
@@ -74,6 +127,37 @@ private:
     void createResources();
     void createImages();
     void updateDescriptorSets();
+    void updateGui();
+    // camera and fractal state of this frame for the backends, rendered at width x height
+    FrameConstants buildFrameConstants(uint32_t width, uint32_t height) const;
+    // same with the animated parameters taken from view
+    FrameConstants buildFrameConstants(const AnimationKey& view, uint32_t width, uint32_t height) const;
+    // the animated parameters of the current view
+    AnimationKey currentView() const;
+    void uploadCpuImage(const RenderContext& ctx, uint32_t width, uint32_t height);
+    // whether target marches frame through the brick map: the cache is on and pays off for the fractal (brickMapPaysOff),
+    // the CPU only uses it without packet marcher
+    bool usesBrickMap(const FrameConstants& frame, Backend target) const;
+    // loads the brick map of frame's fractal from cDirCache or builds and saves it, then hands it to the backends
+    void updateBrickMap(const FrameConstants& frame);
+    // starts meshing the current fractal into an OBJ file in cDirExports on the worker of meshExporter
+    void exportMesh();
+    // shows the progress of the mesh export, logs the result once it is over
+    void updateMeshExport();
+    // starts or continues the offline render of the current view into a TIFF in cDirExports
+    void startOfflineRender();
+    // renders the next tile of the offline render on the CPU backend, closes the job and returns false once none is left
+    bool renderOfflineTile();
+    // fetches the counters of the instrumented frame just rendered from the backend and evaluates them
+    void updatePixelStatistics(const FrameConstants& frame);
+    // shows pixelStatistics in the gui
+    void pixelStatisticsGui();
+    // writes pixelCounters to a CSV in cDirExports
+    void dumpPixelCounters() const;
+    // renders the timeline into a PNG sequence in cDirExports
+    void startAnimation();
+    // renders the next frame of the animation on the CPU backend, closes the job and returns false once none is left
+    bool renderAnimationFrame();
 
 private:
     ShaderDependencyReference fsPipelineRef;
@@ -83,6 +167,7 @@ private:
     void* colorImageNativeHandle;
     QueryInfo<2> query;
     vk::Sampler fsSampler;
+    std::array<VulkanBuffer, MAX_FRAMES_IN_FLIGHT> cpuStagingBuffers; // host image of the cpu backend is uploaded through these
     std::array<VulkanBuffer, MAX_FRAMES_IN_FLIGHT> perFrameBuffers;
     DescriptorPoolBuilder descriptorPoolBuilder;
     DescriptorSetBuilder perFrameDscSetBuilder;
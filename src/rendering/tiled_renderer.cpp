@@ -0,0 +1,197 @@
+#include "rendering/tiled_renderer.h"
+#include "fractal/mandelbulb.h"
+#include <cstring>
+
+// head of the progress file, followed by one byte per tile
+struct TiledRenderProgressHeader {
+    char magic[4] = { 'F', 'T', 'R', 'P' };
+    uint32_t version = 1;
+    uint64_t job = 0; // jobHash
+    uint32_t tileCount = 0;
+    uint32_t pad = 0;
+};
+
+uint64_t TiledRenderer::jobHash(const FrameConstants& frame, const TiledRenderSettings& settings)
+{
+    // the image of frame, which includes its size, and how it is split and sampled
+    uint64_t hash = hashImage(frame);
+    auto add = [&hash](const auto& value) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t i = 0; i < sizeof(value); ++i) hash = (hash ^ bytes[i]) * 1099511628211ull;
+    };
+    add(settings.tileSize);
+    add(settings.samples);
+    return hash;
+}
+
+void renderSamples(FrameConstants frame, int samples, const TileRenderFunction& render, uint32_t* pixels)
+{
+    // the passes of the progressive refinement up to the one the interactive view stops at, see cRefinementSubsets
+    uint32_t passes = samples > 1 ? cRefinementSubsets + (uint32_t)samples - 1 : 1;
+    frame.reprojection = false;
+    frame.progressive = samples > 1;
+    for (uint32_t pass = 0; pass < passes; ++pass) {
+        frame.refinementPass = pass;
+        render(frame, pass + 1 == passes ? pixels : nullptr);
+    }
+}
+
+FrameConstants TiledRenderer::tileFrame(const FrameConstants& frame, const glm::dmat4& rayTransform, uint32_t x0, uint32_t y0, uint32_t w, uint32_t h)
+{
+    // get_image_ray maps pixel (x, y) of the tile to u = x / min(w, h) - w / 2h, v = y / min(w, h) - 1 / 2.
+    // Pixel (x0 + x, y0 + y) of the image has U = s * u + cu, V = s * v + cv in its coordinates, with s the ratio of
+    // the shorter sides. Substituting that into the direction U * ray[0] + V * ray[1] + ray[2] gives the tile's transform
+    double imageMin = (double)glm::min(frame.width, frame.height);
+    double tileMin = (double)glm::min(w, h);
+    double s = tileMin / imageMin;
+    double cu = (x0 + 0.5 * tileMin * w / h) / imageMin - 0.5 * frame.width / frame.height;
+    double cv = (y0 + 0.5 * tileMin) / imageMin - 0.5;
+    glm::dmat4 tileTransform = rayTransform;
+    tileTransform[0] = s * rayTransform[0];
+    tileTransform[1] = s * rayTransform[1];
+    tileTransform[2] = cu * rayTransform[0] + cv * rayTransform[1] + rayTransform[2];
+
+    FrameConstants tile = frame;
+    tile.rayTransform = glm::mat4(tileTransform);
+    tile.deepRayTransform = glm::dmat3(tileTransform);
+    tile.width = w;
+    tile.height = h;
+    tile.reprojection = false;
+    tile.progressive = false;
+    tile.refinementPass = 0;
+    return tile;
+}
+
+bool TiledRenderer::start(const std::filesystem::path& path, const FrameConstants& frame, const glm::dmat4& rayTransform, const TiledRenderSettings& settings)
+{
+    finish();
+    imagePath = path;
+    this->frame = frame;
+    this->rayTransform = rayTransform;
+    this->settings = settings;
+    this->settings.samples = std::max(settings.samples, 1);
+
+    auto progressPath = std::filesystem::path(path).concat(".progress");
+    TiledRenderProgressHeader header;
+    header.job = jobHash(frame, this->settings);
+
+    // continue a job of the same image if both files survived
+    if (image.reopen(path, settings.width, settings.height, settings.tileSize)) {
+        header.tileCount = image.tileCount();
+        progress.open(progressPath, std::ios::binary | std::ios::in | std::ios::out);
+        TiledRenderProgressHeader found;
+        progress.read(reinterpret_cast<char*>(&found), sizeof(found));
+        tileDone.assign(header.tileCount, 0);
+        progress.read(reinterpret_cast<char*>(tileDone.data()), tileDone.size());
+        if (!progress || memcmp(&found, &header, sizeof(header)) != 0) {
+            progress.close();
+            image.close();
+        }
+    }
+    if (!image.isOpen()) {
+        if (!image.create(path, settings.width, settings.height, settings.tileSize)) return false;
+        header.tileCount = image.tileCount();
+        tileDone.assign(header.tileCount, 0);
+        progress.clear();
+        progress.open(progressPath, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+        progress.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        progress.write(reinterpret_cast<const char*>(tileDone.data()), tileDone.size());
+        progress.flush();
+        if (!progress) {
+            progress.close();
+            image.close();
+            return false;
+        }
+    }
+    progress.clear();
+
+    nextTile = 0;
+    resumed = 0;
+    for (uint8_t done : tileDone) resumed += done;
+    written = resumed;
+    queue.reset();
+    failed = false;
+    writer = std::thread(&TiledRenderer::writerLoop, this);
+    return true;
+}
+
+bool TiledRenderer::renderNextTile(const TileRenderFunction& renderTile)
+{
+    if (!active()) return false;
+    while (nextTile < tileCount() && tileDone[nextTile]) ++nextTile;
+    if (nextTile == tileCount()) return false;
+
+    uint32_t tilesX = image.tilesX();
+    uint32_t x0 = nextTile % tilesX * settings.tileSize, y0 = nextTile / tilesX * settings.tileSize;
+    uint32_t w = std::min(settings.tileSize, settings.width - x0), h = std::min(settings.tileSize, settings.height - y0);
+    FrameConstants tile = tileFrame(frame, rayTransform, x0, y0, w, h);
+
+    std::vector<uint32_t> pixels;
+    {
+        std::lock_guard lock(mutex);
+        if (!freeBuffers.empty()) {
+            pixels = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+    }
+    pixels.resize((size_t)w * h);
+    renderSamples(tile, settings.samples, renderTile, pixels.data());
+    queue.push({ nextTile++, std::move(pixels) });
+    return true;
+}
+
+void TiledRenderer::writerLoop()
+{
+    uint32_t tileSize = settings.tileSize;
+    std::vector<uint8_t> rgb(image.tileBytes());
+    QueuedTile tile;
+    while (queue.pop(tile)) {
+        // R8G8B8A8 rows of the tile width to the padded RGB tile of the file
+        uint32_t x0 = tile.index % image.tilesX() * tileSize, y0 = tile.index / image.tilesX() * tileSize;
+        uint32_t w = std::min(tileSize, settings.width - x0), h = std::min(tileSize, settings.height - y0);
+        std::fill(rgb.begin(), rgb.end(), (uint8_t)0);
+        for (uint32_t y = 0; y < h; ++y) {
+            const uint32_t* src = tile.pixels.data() + (size_t)y * w;
+            uint8_t* dst = rgb.data() + (size_t)y * tileSize * 3;
+            for (uint32_t x = 0; x < w; ++x) {
+                uint32_t texel = src[x];
+                *dst++ = (uint8_t)texel;
+                *dst++ = (uint8_t)(texel >> 8);
+                *dst++ = (uint8_t)(texel >> 16);
+            }
+        }
+
+        // the tile is marked only once its data is flushed, a crash in between renders it again
+        bool ok = image.writeTile(tile.index, rgb.data());
+        if (ok) {
+            tileDone[tile.index] = 1;
+            progress.seekp((std::streamoff)(sizeof(TiledRenderProgressHeader) + tile.index));
+            progress.put(1);
+            progress.flush();
+            ok = progress.good();
+            ++written;
+        }
+
+        std::lock_guard lock(mutex);
+        failed = failed || !ok;
+        freeBuffers.push_back(std::move(tile.pixels));
+    }
+}
+
+bool TiledRenderer::finish()
+{
+    if (writer.joinable()) {
+        queue.close();
+        writer.join();
+    }
+    bool ok = !failed;
+    bool complete = active() && written == tileCount();
+    image.close();
+    progress.close();
+    if (complete && ok) {
+        std::error_code error;
+        std::filesystem::remove(std::filesystem::path(imagePath).concat(".progress"), error);
+    }
+    freeBuffers.clear();
+    return ok;
+}
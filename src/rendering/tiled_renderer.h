@@ -0,0 +1,93 @@
+#ifndef TILED_RENDERER_H
+#define TILED_RENDERER_H
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "fractal/frame_constants.h"
+#include "utility/bounded_queue.h"
+#include "utility/tiff_writer.h"
+
+// Offline render of images far larger than the screen, e.g. gigapixel prints.
+// The image is split into tiles that are rendered one after the other as frames of their own, every tile by all threads
+// of the backend. The rayTransform of a tile maps its pixels to the rays of the same pixels of the whole image, the hit
+// threshold, the step budget and the deep zoom reference are the ones of the whole image, so the tiles join seamlessly.
+// Finished tiles go to a writer thread that puts them into a tiled TIFF while the next tile renders. Only the tiles in
+// flight are held in memory, whatever the size of the image.
+// A progress file next to the image records the tiles on disk: starting the job again for the same image and settings
+// (after a crash or a stop) renders only the missing tiles
+
+struct TiledRenderSettings {
+    uint32_t width = 16384, height = 16384;
+    // edge of the square tiles, a multiple of 16. Must not exceed the image the backend renders into
+    uint32_t tileSize = 512;
+    // samples per pixel: 1 shades the pixel centres, more run the progressive refinement passes on every tile
+    int samples = 16;
+};
+
+// renders one pass of a tile (tile.width x tile.height). pixels is null but for the last pass of the tile, then it
+// receives the result: R8G8B8A8 texels, rows of tile.width
+using TileRenderFunction = std::function<void(const FrameConstants& tile, uint32_t* pixels)>;
+
+// renders frame with samples per pixel through render, see TiledRenderSettings::samples. pixels gets the result
+void renderSamples(FrameConstants frame, int samples, const TileRenderFunction& render, uint32_t* pixels);
+
+class TiledRenderer {
+public:
+    // tiles rendered ahead of the writer, the renderer waits for it beyond
+    static constexpr size_t cMaxQueuedTiles = 2;
+
+    ~TiledRenderer() { finish(); }
+
+    // frame: built for settings.width x settings.height, rayTransform its camera in double precision. Continues the job
+    // of the same image if path and its progress file hold one, otherwise creates path. false if it could not be created
+    bool start(const std::filesystem::path& path, const FrameConstants& frame, const glm::dmat4& rayTransform, const TiledRenderSettings& settings);
+    // renders the next tile that is not on disk yet and queues it for the writer. false if no tile is left
+    bool renderNextTile(const TileRenderFunction& renderTile);
+    // waits for the queued tiles and closes the image, the progress file is removed once every tile is on disk.
+    // false if a tile could not be written
+    bool finish();
+
+    bool active() const { return image.isOpen(); }
+    const std::filesystem::path& path() const { return imagePath; }
+    uint32_t tileSize() const { return settings.tileSize; }
+    uint32_t tileCount() const { return (uint32_t)tileDone.size(); }
+    // tiles on disk, including the ones found there by start
+    uint32_t tilesWritten() const { return written; }
+    uint32_t tilesResumed() const { return resumed; }
+
+    // frame of the w x h pixels at (x0, y0) of the image of frame
+    static FrameConstants tileFrame(const FrameConstants& frame, const glm::dmat4& rayTransform, uint32_t x0, uint32_t y0, uint32_t w, uint32_t h);
+
+private:
+    struct QueuedTile {
+        uint32_t index;
+        std::vector<uint32_t> pixels;
+    };
+
+    void writerLoop();
+    static uint64_t jobHash(const FrameConstants& frame, const TiledRenderSettings& settings);
+
+    std::filesystem::path imagePath;
+    FrameConstants frame = {};
+    glm::dmat4 rayTransform = glm::dmat4(1.0);
+    TiledRenderSettings settings;
+    TiledTiffWriter image;
+    std::fstream progress; // header, then one byte per tile, 1 once it is on disk
+    std::vector<uint8_t> tileDone; // as in the progress file, written by the writer thread
+    uint32_t nextTile = 0; // tiles before it are rendered or on disk
+    uint32_t resumed = 0;
+    std::atomic<uint32_t> written = 0;
+
+    std::thread writer;
+    BoundedQueue<QueuedTile> queue{ cMaxQueuedTiles };
+    std::mutex mutex; // of the members below
+    std::vector<std::vector<uint32_t>> freeBuffers; // pixels of written tiles, reused
+    bool failed = false;
+};
+
+#endif//TILED_RENDERER_H
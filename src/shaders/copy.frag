@@ -2,10 +2,18 @@
 
 layout(location = 0) in vec2 uv;
 
+layout(set = 0, binding = 0) uniform PerFrameUniformData {
+    mat4 v;
+    vec4 ambientLight;
+    vec4 renderScale; // xy: rendered fraction of the source image, zw: largest uv that only samples rendered texels
+};
 layout(set = 0, binding = 1) uniform sampler2D source;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(source, uv);
+    // dynamic resolution renders into the top left corner of source, stretch it over the screen.
+    // The clamp keeps the bilinear taps away from the texels outside of it (and from wrapping around at 0)
+    vec2 halfTexel = 0.5 / vec2(textureSize(source, 0));
+    outColor = texture(source, clamp(uv * renderScale.xy, halfTexel, renderScale.zw));
 }
\ No newline at end of file
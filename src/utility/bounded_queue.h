@@ -0,0 +1,70 @@
+#ifndef VULKAN_INTRO_BOUNDED_QUEUE_H
+#define VULKAN_INTRO_BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// Blocking FIFO of at most capacity items between the stages of a pipeline.
+// A full queue blocks the producer, so a slow stage holds the ones before it back instead of letting items pile up.
+// close() ends the stream: pushes fail, pops return what is left and then false
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    // blocks while the queue is full, false if it is closed
+    bool push(T item)
+    {
+        std::unique_lock lock(mutex);
+        notFull.wait(lock, [&] { return items.size() < capacity || closed; });
+        if (closed) return false;
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // blocks while the queue is empty, false once it is closed and drained
+    bool pop(T& item)
+    {
+        std::unique_lock lock(mutex);
+        notEmpty.wait(lock, [&] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard lock(mutex);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    // reopens a closed queue for the next stream, drops what is left of the last one
+    void reset()
+    {
+        std::lock_guard lock(mutex);
+        items.clear();
+        closed = false;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard lock(mutex);
+        return items.size();
+    }
+
+private:
+    size_t capacity;
+    mutable std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+    std::deque<T> items;
+    bool closed = false;
+};
+
+#endif//VULKAN_INTRO_BOUNDED_QUEUE_H
@@ -0,0 +1,111 @@
+#include "utility/thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+    if (threadCount == 0) threadCount = 1;
+
+    queues.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        queues.push_back(std::make_unique<TaskQueue>());
+    }
+
+    workers.reserve(threadCount - 1);
+    for (unsigned int i = 0; i + 1 < threadCount; ++i) {
+        workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock{ stateMutex };
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (auto& it : workers) it.join();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task)
+{
+    if (count == 0) return;
+
+    std::lock_guard jobLock{ jobMutex };
+
+    // publish the task before any index becomes visible: a worker still spinning in runTasks may pick them up early
+    {
+        std::lock_guard lock{ stateMutex };
+        currentTask = &task;
+        remainingTasks = count;
+    }
+
+    // deal the indices round robin so neighbouring tiles (similar cost) end up on different threads
+    for (size_t i = 0; i < count; ++i) {
+        auto& queue = *queues[i % queues.size()];
+        std::lock_guard lock{ queue.mutex };
+        queue.indices.push_back(i);
+    }
+
+    {
+        std::lock_guard lock{ stateMutex };
+        ++jobGeneration;
+    }
+    jobAvailable.notify_all();
+
+    runTasks(queues.size() - 1);
+
+    std::unique_lock lock{ stateMutex };
+    jobFinished.wait(lock, [this]() { return remainingTasks == 0; });
+    currentTask = nullptr;
+}
+
+void ThreadPool::workerLoop(size_t queueIndex)
+{
+    uint64_t seenGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock lock{ stateMutex };
+            jobAvailable.wait(lock, [&]() { return stopping || jobGeneration != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = jobGeneration;
+        }
+        runTasks(queueIndex);
+    }
+}
+
+void ThreadPool::runTasks(size_t queueIndex)
+{
+    size_t taskIndex;
+    while (popTask(queueIndex, taskIndex)) {
+        // currentTask stays valid while any index is unfinished, parallelFor waits for remainingTasks == 0
+        (*currentTask)(taskIndex);
+        if (--remainingTasks == 0) {
+            std::lock_guard lock{ stateMutex };
+            jobFinished.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::popTask(size_t queueIndex, size_t& taskIndex)
+{
+    {
+        auto& own = *queues[queueIndex];
+        std::lock_guard lock{ own.mutex };
+        if (!own.indices.empty()) {
+            taskIndex = own.indices.front();
+            own.indices.pop_front();
+            return true;
+        }
+    }
+
+    // steal from the back of the other queues
+    for (size_t i = 1; i < queues.size(); ++i) {
+        auto& victim = *queues[(queueIndex + i) % queues.size()];
+        std::lock_guard lock{ victim.mutex };
+        if (!victim.indices.empty()) {
+            taskIndex = victim.indices.back();
+            victim.indices.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
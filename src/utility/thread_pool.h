@@ -0,0 +1,57 @@
+#ifndef VULKAN_INTRO_THREAD_POOL_H
+#define VULKAN_INTRO_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool for data parallel jobs (e.g. screen tiles).
+// Every worker owns a deque of task indices: it pops from the front of its own deque and when that runs dry
+// it steals from the back of the others, so uneven tiles (sky vs. fractal surface) still keep every core busy.
+class ThreadPool {
+public:
+    static ThreadPool& instance() { static ThreadPool pool; return pool; }
+
+    explicit ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // calls task(i) for every i in [0, count) and blocks until all of them finished
+    // the calling thread takes part in the work. Jobs submitted from multiple threads are serialized
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+    // number of threads executing a job, including the caller of parallelFor
+    unsigned int threadCount() const { return (unsigned int)queues.size(); }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<size_t> indices;
+    };
+
+    void workerLoop(size_t queueIndex);
+    void runTasks(size_t queueIndex);
+    bool popTask(size_t queueIndex, size_t& taskIndex);
+
+private:
+    std::vector<std::unique_ptr<TaskQueue>> queues; // last queue belongs to the caller of parallelFor
+    std::vector<std::thread> workers;
+
+    std::mutex jobMutex;
+    std::mutex stateMutex;
+    std::condition_variable jobAvailable, jobFinished;
+    const std::function<void(size_t)>* currentTask = nullptr;
+    std::atomic<size_t> remainingTasks = 0;
+    uint64_t jobGeneration = 0;
+    bool stopping = false;
+};
+
+inline auto& theThreadPool = ThreadPool::instance();
+
+#endif//VULKAN_INTRO_THREAD_POOL_H
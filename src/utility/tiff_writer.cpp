@@ -0,0 +1,156 @@
+#include "utility/tiff_writer.h"
+#include <vector>
+
+// TIFF 6.0 tags of the image file directory, in the ascending order the format requires
+enum TiffTag : uint16_t {
+    ImageWidth = 256, ImageLength = 257, BitsPerSample = 258, Compression = 259, PhotometricInterpretation = 262,
+    SamplesPerPixel = 277, PlanarConfiguration = 284, TileWidth = 322, TileLength = 323, TileOffsets = 324, TileByteCounts = 325,
+};
+enum TiffType : uint16_t { Short = 3, Long = 4, Long8 = 16 };
+constexpr uint16_t cTiffEntryCount = 11;
+// tile data starts at a page boundary
+constexpr uint64_t cTiffDataAlignment = 4096;
+
+// little endian, the byte order announced by "II"
+static void put(std::vector<uint8_t>& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+// header, directory and the out of line BitsPerSample of a file with this layout. The tile tables follow it directly
+static std::vector<uint8_t> headerBytes(uint32_t width, uint32_t height, uint32_t tileSize, uint32_t tileCount, bool bigTiff, uint64_t dataOffset)
+{
+    // classic TIFF: 32 bit offsets, 12 byte entries. BigTIFF: 64 bit offsets, 20 byte entries
+    int offsetBytes = bigTiff ? 8 : 4;
+    uint64_t tileBytes = (uint64_t)tileSize * tileSize * 3;
+    uint64_t directoryOffset = bigTiff ? 16 : 8;
+    uint64_t directoryBytes = (bigTiff ? 8 : 2) + cTiffEntryCount * (bigTiff ? 20 : 12) + offsetBytes;
+    // three 8 bit samples fit into the value field of a BigTIFF entry only
+    uint64_t bitsOffset = directoryOffset + directoryBytes;
+    uint64_t offsetsTable = bitsOffset + (bigTiff ? 0 : 8);
+    uint64_t countsTable = offsetsTable + (uint64_t)tileCount * offsetBytes;
+
+    std::vector<uint8_t> out = { 'I', 'I' };
+    if (bigTiff) {
+        put(out, 43, 2);
+        put(out, 8, 2);
+        put(out, 0, 2);
+    } else {
+        put(out, 42, 2);
+    }
+    put(out, directoryOffset, offsetBytes);
+
+    put(out, cTiffEntryCount, bigTiff ? 8 : 2);
+    // values that fit into the value field are stored in it, left aligned
+    auto entry = [&](uint16_t tag, uint16_t type, uint64_t count, uint64_t value) {
+        put(out, tag, 2);
+        put(out, type, 2);
+        put(out, count, offsetBytes);
+        put(out, value, offsetBytes);
+    };
+    uint16_t tableType = bigTiff ? Long8 : Long;
+    entry(ImageWidth, Long, 1, width);
+    entry(ImageLength, Long, 1, height);
+    entry(BitsPerSample, Short, 3, bigTiff ? 0x000800080008ull : bitsOffset);
+    entry(Compression, Short, 1, 1); // none
+    entry(PhotometricInterpretation, Short, 1, 2); // RGB
+    entry(SamplesPerPixel, Short, 1, 3);
+    entry(PlanarConfiguration, Short, 1, 1); // interleaved
+    entry(TileWidth, Long, 1, tileSize);
+    entry(TileLength, Long, 1, tileSize);
+    entry(TileOffsets, tableType, tileCount, tileCount > 1 ? offsetsTable : dataOffset);
+    entry(TileByteCounts, tableType, tileCount, tileCount > 1 ? countsTable : tileBytes);
+    put(out, 0, offsetBytes); // no next directory
+
+    if (!bigTiff) {
+        for (int i = 0; i < 3; ++i) put(out, 8, 2);
+        put(out, 0, 2);
+    }
+    return out;
+}
+
+void TiledTiffWriter::layout(uint32_t width, uint32_t height, uint32_t tileSize)
+{
+    this->width = width;
+    this->height = height;
+    this->tileSize = tileSize;
+    // a classic file if everything stays below 4 GiB
+    for (bool big : { false, true }) {
+        bigTiff = big;
+        uint64_t tables = tileCount() > 1 ? 2ull * tileCount() * (big ? 8 : 4) : 0;
+        uint64_t end = headerBytes(width, height, tileSize, tileCount(), big, 0).size() + tables;
+        dataOffset = (end + cTiffDataAlignment - 1) / cTiffDataAlignment * cTiffDataAlignment;
+        if (fileBytes() <= 0xffffffffull) break;
+    }
+}
+
+bool TiledTiffWriter::create(const std::filesystem::path& path, uint32_t width, uint32_t height, uint32_t tileSize)
+{
+    close();
+    if (width == 0 || height == 0 || tileSize == 0 || tileSize % 16 != 0) return false;
+    layout(width, height, tileSize);
+
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+        auto header = headerBytes(width, height, tileSize, tileCount(), bigTiff, dataOffset);
+        out.write(reinterpret_cast<const char*>(header.data()), header.size());
+        // the tables are streamed, they are the only part of the file that grows with the tile count
+        if (tileCount() > 1) {
+            std::vector<uint8_t> row;
+            for (int table = 0; table < 2; ++table) {
+                for (uint32_t i = 0; i < tileCount(); ++i) {
+                    put(row, table == 0 ? dataOffset + i * tileBytes() : tileBytes(), bigTiff ? 8 : 4);
+                    if (row.size() >= 65536 || i + 1 == tileCount()) {
+                        out.write(reinterpret_cast<const char*>(row.data()), row.size());
+                        row.clear();
+                    }
+                }
+            }
+        }
+        if (!out.good()) return false;
+    }
+    // the tiles not written yet read as black, most file systems do not even allocate them
+    std::error_code error;
+    std::filesystem::resize_file(path, fileBytes(), error);
+    if (error) return false;
+
+    file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+    return file.is_open();
+}
+
+bool TiledTiffWriter::reopen(const std::filesystem::path& path, uint32_t width, uint32_t height, uint32_t tileSize)
+{
+    close();
+    if (width == 0 || height == 0 || tileSize == 0 || tileSize % 16 != 0) return false;
+    layout(width, height, tileSize);
+
+    std::error_code error;
+    if (std::filesystem::file_size(path, error) != fileBytes() || error) return false;
+    file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!file.is_open()) return false;
+
+    auto expected = headerBytes(width, height, tileSize, tileCount(), bigTiff, dataOffset);
+    std::vector<uint8_t> header(expected.size());
+    file.read(reinterpret_cast<char*>(header.data()), header.size());
+    if (!file || header != expected) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool TiledTiffWriter::writeTile(uint32_t index, const uint8_t* rgb)
+{
+    if (!file.is_open() || index >= tileCount()) return false;
+    file.seekp((std::streamoff)(dataOffset + index * tileBytes()));
+    file.write(reinterpret_cast<const char*>(rgb), (std::streamsize)tileBytes());
+    file.flush();
+    return file.good();
+}
+
+void TiledTiffWriter::close()
+{
+    if (file.is_open()) file.close();
+    file.clear();
+}
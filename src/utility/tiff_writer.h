@@ -0,0 +1,41 @@
+#ifndef VULKAN_INTRO_TIFF_WRITER_H
+#define VULKAN_INTRO_TIFF_WRITER_H
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+
+// Uncompressed 8 bit RGB TIFF split into tiles, for images too large to keep in memory.
+// The header and the tile tables are written by create, the file is sized for every tile up front and each tile goes
+// to its fixed place, so tiles can be written in any order and a file can be reopened to fill in the missing ones.
+// Files past 4 GiB are written as BigTIFF
+class TiledTiffWriter {
+public:
+    ~TiledTiffWriter() { close(); }
+
+    // creates path, overwriting it. tileSize must be a multiple of 16. false if the file could not be written
+    bool create(const std::filesystem::path& path, uint32_t width, uint32_t height, uint32_t tileSize);
+    // reopens a file made by create with the same size and tile size, false if path is not such a file
+    bool reopen(const std::filesystem::path& path, uint32_t width, uint32_t height, uint32_t tileSize);
+    // rgb: tileSize^2 texels, rows of tileSize. Tiles are numbered row by row, the ones on the right and bottom edges
+    // are padded. The data is flushed to the file before it returns
+    bool writeTile(uint32_t index, const uint8_t* rgb);
+    void close();
+
+    bool isOpen() const { return file.is_open(); }
+    uint32_t tilesX() const { return (width + tileSize - 1) / tileSize; }
+    uint32_t tilesY() const { return (height + tileSize - 1) / tileSize; }
+    uint32_t tileCount() const { return tilesX() * tilesY(); }
+    uint64_t tileBytes() const { return (uint64_t)tileSize * tileSize * 3; }
+    uint64_t fileBytes() const { return dataOffset + tileCount() * tileBytes(); }
+
+private:
+    // computes the layout of the file, the header, tables and tiles of a file of this size
+    void layout(uint32_t width, uint32_t height, uint32_t tileSize);
+
+    std::fstream file;
+    uint32_t width = 0, height = 0, tileSize = 0;
+    bool bigTiff = false;
+    uint64_t dataOffset = 0; // of tile 0, the others follow without gaps
+};
+
+#endif//VULKAN_INTRO_TIFF_WRITER_H
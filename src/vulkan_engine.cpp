@@ -118,16 +118,18 @@ VulkanEngine::Result VulkanEngine::drawFrame(Renderer* pRenderer, PerspectiveCam
 
     vk::SubmitInfo submitInfo = {};
 
-    vk::Semaphore waitSemaphores[] = {pRenderer->vulkanWaitsForCudaSemaphore, imageAvailableSemaphores[currentFrame]};
-    vk::PipelineStageFlags waitStages[] = {vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eAllCommands};
-    submitInfo.waitSemaphoreCount = 2;
+    // the cuda semaphores are only part of the submission if cuda rendered this frame
+    bool cudaInterop = pRenderer->usesCudaInterop();
+    vk::Semaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame], pRenderer->vulkanWaitsForCudaSemaphore};
+    vk::PipelineStageFlags waitStages[] = {vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eColorAttachmentOutput};
+    submitInfo.waitSemaphoreCount = cudaInterop ? 2 : 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
     vk::Semaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame], pRenderer->cudaWaitsForVulkanSemaphore };
-    submitInfo.signalSemaphoreCount = 2;
+    submitInfo.signalSemaphoreCount = cudaInterop ? 2 : 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
     VK_CHECK_RESULT(vl.device.resetFences(1, &inFlightFences[currentFrame]))